@@ -10,4 +10,4 @@ if [[ ! -x "${BIN}" ]]; then
   exit 1
 fi
 
-"${BIN}"
+"${BIN}" "$@"
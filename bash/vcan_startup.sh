@@ -0,0 +1,25 @@
+#!/bin/sh
+set -eu
+
+# 実機なしで複数バスの割り当て (--can-bus) を試すための仮想 CAN インタフェースを作る．
+VCAN_IFS="vcan0 vcan1"
+TXQLEN=1000
+
+sudo modprobe vcan
+
+for VCAN_IF in ${VCAN_IFS}; do
+	echo "Starting virtual CAN interface: ${VCAN_IF}"
+
+	if ! ip link show ${VCAN_IF} > /dev/null 2>&1; then
+		sudo ip link add dev ${VCAN_IF} type vcan
+	fi
+
+	sudo ip link set ${VCAN_IF} txqueuelen ${TXQLEN}
+
+	sudo ip link set ${VCAN_IF} up
+done
+
+echo "CAN interface status:"
+for VCAN_IF in ${VCAN_IFS}; do
+	ip -details link show ${VCAN_IF}
+done
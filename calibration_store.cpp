@@ -0,0 +1,97 @@
+#include "calibration_store.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+
+namespace {
+bool write_all(const int fd, const void* data, const size_t size) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t n = write(fd, p + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+}  // namespace
+
+bool calibration_save(const char* path, CalibrationRecord& record) {
+    record.saved_unix_sec = static_cast<int64_t>(std::time(nullptr));
+
+    CalibFileHeader header{};
+    std::memcpy(header.magic, CALIB_FILE_MAGIC, sizeof(header.magic));
+    header.version = CALIB_FILE_VERSION;
+    header.joint_count = NUM_ODRIVE;
+    header.saved_unix_sec = record.saved_unix_sec;
+
+    const std::string tmp_path = std::string(path) + ".tmp";
+    const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "[CALIB] open(" << tmp_path << ") failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    const bool ok = write_all(fd, &header, sizeof(header))
+                 && write_all(fd, record.joints.data(), sizeof(JointCalibration) * record.joints.size())
+                 && fsync(fd) == 0;
+    const int saved_errno = errno;
+    close(fd);
+    if (!ok) {
+        std::cerr << "[CALIB] write(" << tmp_path << ") failed: " << std::strerror(saved_errno) << std::endl;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    if (std::rename(tmp_path.c_str(), path) != 0) {
+        std::cerr << "[CALIB] rename(" << path << ") failed: " << std::strerror(errno) << std::endl;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    std::cout << "[CALIB] Saved calibration to " << path << ". / キャリブレーション結果を保存しました．" << std::endl;
+    return true;
+}
+
+bool calibration_load(const char* path, CalibrationRecord& record) {
+    FILE* fp = std::fopen(path, "rb");
+    if (fp == nullptr) {
+        std::cout << "[CALIB] No saved calibration (" << path << "): " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    CalibFileHeader header{};
+    const bool has_header = std::fread(&header, sizeof(header), 1, fp) == 1;
+    if (!has_header || std::memcmp(header.magic, CALIB_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << "[CALIB] " << path << " is not a calibration file." << std::endl;
+        std::fclose(fp);
+        return false;
+    }
+    if (header.version != CALIB_FILE_VERSION || header.joint_count != NUM_ODRIVE) {
+        std::cerr << "[CALIB] " << path << ": unsupported version " << header.version
+                  << " / joint_count " << header.joint_count << std::endl;
+        std::fclose(fp);
+        return false;
+    }
+
+    CalibrationRecord loaded;
+    loaded.saved_unix_sec = header.saved_unix_sec;
+    const bool ok = std::fread(loaded.joints.data(), sizeof(JointCalibration), loaded.joints.size(), fp)
+                    == loaded.joints.size();
+    std::fclose(fp);
+    if (!ok) {
+        std::cerr << "[CALIB] " << path << " is truncated." << std::endl;
+        return false;
+    }
+    record = loaded;
+    return true;
+}
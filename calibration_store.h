@@ -0,0 +1,51 @@
+#pragma once
+
+// ゼロ点キャリブレーションの結果を保存するファイル (既定は calibration.bin) の形式と読み書き．
+//
+// ファイルは CalibFileHeader の後に，JointCalibration が joint_count 個続く．
+// 値はすべてリトルエンディアン，パディング無し．
+// 書き込みは一時ファイルに書いてから rename() するので，途中で止まっても古いファイルは壊れない．
+
+#include <array>
+#include <cstdint>
+
+#include "global_variable.h"
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "calibration file is written in host byte order and assumes little endian");
+
+constexpr char CALIB_FILE_MAGIC[4] = {'G', 'W', 'C', 'L'};
+constexpr uint16_t CALIB_FILE_VERSION = 1;
+
+// JointCalibration の flags．
+constexpr uint32_t CALIB_FLAG_POT     = 1u << 0;  // pot_zero が有効 (ゼロ点合わせした関節)．
+constexpr uint32_t CALIB_FLAG_ENCODER = 1u << 1;  // encoder_offset が有効．
+
+#pragma pack(push, 1)
+struct CalibFileHeader {
+    char magic[4];           // "GWCL"
+    uint16_t version;        // CALIB_FILE_VERSION
+    uint16_t joint_count;    // 続く JointCalibration の数．
+    int64_t saved_unix_sec;  // 保存した時刻 (UNIX 時刻)．
+};
+
+struct JointCalibration {
+    uint32_t flags;
+    float pot_zero;        // ゼロ点でのポテンショメータ値 (ADC 値)．
+    float encoder_offset;  // ゼロ点に合わせた時点の ODrive の位置推定値 [rot] (絶対位置を 0 にする前)．
+};
+#pragma pack(pop)
+
+static_assert(sizeof(CalibFileHeader) == 16, "CalibFileHeader layout changed");
+static_assert(sizeof(JointCalibration) == 12, "JointCalibration layout changed");
+
+struct CalibrationRecord {
+    int64_t saved_unix_sec = 0;
+    std::array<JointCalibration, NUM_ODRIVE> joints{};  // index は node_id - 1．
+};
+
+// record を path に保存する．saved_unix_sec は現在時刻で上書きする．失敗したら理由を表示して false．
+bool calibration_save(const char* path, CalibrationRecord& record);
+
+// path から読み込む．無い・形式が違う場合は理由を表示して false．
+bool calibration_load(const char* path, CalibrationRecord& record);
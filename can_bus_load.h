@@ -0,0 +1,316 @@
+#pragma once
+
+#include <fcntl.h>
+#include <linux/can.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <ostream>
+
+#include "can_topology.h"
+
+// CAN バスの使用率 (bus load) の見積もり．
+//
+// 送受信したフレームごとに，バス上で占めるビット数をビットスタッフィング込みで数える．
+// スタッフビットは ID・データ・CRC から実際のビット列を組み立てて数えるので，最悪値ではなく実際の値．
+// can_rx はフィルタを通ったフレーム (登録した ID) しか見ないので，受信はインタフェースの統計
+// (/sys/class/net/IF/statistics/rx_packets, rx_bytes) も読み，can_rx が見ていない分のフレームを
+// CAN_UNSEEN_STUFF_RATIO のスタッフビットを見込んだ標準 ID のフレームとして足す．
+// sysfs のファイルは Reset() で開いたままにして pread() で読むので，Sample() はメモリを確保しない．
+// sysfs が読めなければ can_rx が見た分だけになる．vcan では自分の送信も rx_packets に入るので多めに出る．
+// インタフェース (can_topology.h) ごとに別々に数える．
+
+// ☆ バスのビットレート (全インタフェース共通)．bash/can_startup.sh の BITRATE と合わせること．
+constexpr uint32_t CAN_BITRATE = 500000;
+
+// ☆ can_rx が見ていない受信フレームに見込むスタッフビットの割合 (スタッフィング対象のビット数に対して)．
+constexpr double CAN_UNSEEN_STUFF_RATIO = 0.1;
+
+// 標準 ID のフレームのうち，データ以外でスタッフィングの対象になるビット数 (SOF, ID, RTR, IDE, r0, DLC, CRC) と，
+// 対象にならないビット数 (CRC デリミタ，ACK，EOF，フレーム間スペース)．
+constexpr uint32_t CAN_SFF_STUFFABLE_OVERHEAD_BITS = 34;
+constexpr uint32_t CAN_FIXED_TAIL_BITS = 13;
+
+// フレームがバス上で占めるビット数 (スタッフビット，ACK，EOF，フレーム間スペースを含む)．
+inline uint32_t can_frame_bits(const can_frame& frame) {
+    uint32_t bits = 0;
+    uint32_t stuffed = 0;
+    uint16_t crc = 0;
+    int last = -1;
+    int run = 0;
+
+    // SOF から CRC の終わりまでがスタッフィングの対象．CRC の計算は SOF からデータの終わりまで.
+    auto push = [&](const int bit, const bool in_crc) {
+        if (in_crc) {
+            const int top = (crc >> 14) & 1;
+            crc = static_cast<uint16_t>((crc << 1) & 0x7FFF);
+            if (bit ^ top) {
+                crc ^= 0x4599;
+            }
+        }
+        ++bits;
+        if (bit == last) {
+            if (++run == 5) {
+                // 同じ値が 5 個続いたら反転したビットを 1 個挟む．挟んだビットから次の連続が始まる.
+                ++stuffed;
+                last = !bit;
+                run = 1;
+            }
+        } else {
+            last = bit;
+            run = 1;
+        }
+    };
+    auto push_field = [&](const uint32_t value, const int width) {
+        for (int i = width - 1; i >= 0; --i) {
+            push((value >> i) & 1, true);
+        }
+    };
+
+    const bool extended = (frame.can_id & CAN_EFF_FLAG) != 0;
+    const bool remote = (frame.can_id & CAN_RTR_FLAG) != 0;
+    const uint8_t dlc = std::min<uint8_t>(frame.can_dlc, CAN_MAX_DLEN);
+
+    push(0, true);  // SOF
+    if (extended) {
+        const uint32_t id = frame.can_id & CAN_EFF_MASK;
+        push_field(id >> 18, 11);
+        push(1, true);  // SRR
+        push(1, true);  // IDE
+        push_field(id & 0x3FFFF, 18);
+        push(remote, true);
+        push_field(0, 2);  // r1, r0
+    } else {
+        push_field(frame.can_id & CAN_SFF_MASK, 11);
+        push(remote, true);
+        push_field(0, 2);  // IDE, r0
+    }
+    push_field(dlc, 4);
+    if (!remote) {
+        for (uint8_t i = 0; i < dlc; ++i) {
+            push_field(frame.data[i], 8);
+        }
+    }
+    const uint16_t crc_value = crc;
+    for (int i = 14; i >= 0; --i) {
+        push((crc_value >> i) & 1, false);
+    }
+
+    // CRC デリミタ 1，ACK 2，EOF 7，フレーム間スペース 3．
+    return bits + stuffed + CAN_FIXED_TAIL_BITS;
+}
+
+// 送受信したフレーム数とビット数の累計．rx_* は can_rx が見た分，if_rx_* はインタフェースの統計．
+struct CanTraffic {
+    uint64_t tx_frames = 0;
+    uint64_t tx_bits = 0;
+    uint64_t rx_frames = 0;
+    uint64_t rx_bits = 0;
+    uint64_t rx_bytes = 0;  // データ部のバイト数.
+    bool has_if_stats = false;
+    uint64_t if_rx_frames = 0;
+    uint64_t if_rx_bytes = 0;
+};
+
+// どのスレッドからでも足してよい.
+struct CanTrafficCounters {
+    std::atomic<uint64_t> tx_frames{0};
+    std::atomic<uint64_t> tx_bits{0};
+    std::atomic<uint64_t> rx_frames{0};
+    std::atomic<uint64_t> rx_bits{0};
+    std::atomic<uint64_t> rx_bytes{0};
+};
+
+// index はインタフェースの番号 (can_topology.h)．
+inline std::array<CanTrafficCounters, CAN_MAX_BUSES> g_can_traffic;
+
+inline void can_traffic_record_tx(const size_t bus, const can_frame& frame) {
+    g_can_traffic[bus].tx_frames.fetch_add(1, std::memory_order_relaxed);
+    g_can_traffic[bus].tx_bits.fetch_add(can_frame_bits(frame), std::memory_order_relaxed);
+}
+
+inline void can_traffic_record_rx(const size_t bus, const can_frame& frame) {
+    g_can_traffic[bus].rx_frames.fetch_add(1, std::memory_order_relaxed);
+    g_can_traffic[bus].rx_bits.fetch_add(can_frame_bits(frame), std::memory_order_relaxed);
+    g_can_traffic[bus].rx_bytes.fetch_add(std::min<uint8_t>(frame.can_dlc, CAN_MAX_DLEN), std::memory_order_relaxed);
+}
+
+// インタフェースの受信統計 (/sys/class/net/IF/statistics/rx_packets, rx_bytes)．
+// Open() で開いたファイルを pread() で先頭から読み直す (sysfs は読むたびに最新の値を返す)．
+class CanIfRxStats final {
+public:
+    CanIfRxStats() = default;
+    ~CanIfRxStats() { Close(); }
+
+    CanIfRxStats(const CanIfRxStats&) = delete;
+    CanIfRxStats& operator=(const CanIfRxStats&) = delete;
+
+    // 開けなければ Read() が false を返すだけ.
+    void Open(const char* interface) {
+        Close();
+        packets_fd_ = OpenStat(interface, "rx_packets");
+        bytes_fd_ = OpenStat(interface, "rx_bytes");
+    }
+
+    void Close() {
+        if (packets_fd_ >= 0) { close(packets_fd_); }
+        if (bytes_fd_ >= 0) { close(bytes_fd_); }
+        packets_fd_ = bytes_fd_ = -1;
+    }
+
+    bool Read(uint64_t& frames, uint64_t& bytes) const {
+        return ReadValue(packets_fd_, frames) && ReadValue(bytes_fd_, bytes);
+    }
+
+private:
+    static int OpenStat(const char* interface, const char* name) {
+        char path[128];
+        std::snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/%s", interface, name);
+        return open(path, O_RDONLY | O_CLOEXEC);
+    }
+
+    static bool ReadValue(const int fd, uint64_t& out) {
+        if (fd < 0) {
+            return false;
+        }
+        char buf[32];
+        const ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+        if (n <= 0) {
+            return false;
+        }
+        buf[n] = '\0';
+        char* end = nullptr;
+        out = std::strtoull(buf, &end, 10);
+        return end != buf;
+    }
+
+    int packets_fd_ = -1;
+    int bytes_fd_ = -1;
+};
+
+// can_tx / can_rx が数えた分の累計．インタフェースの統計は入れない (CanIfRxStats)．
+inline CanTraffic can_traffic_snapshot(const size_t bus) {
+    const CanTrafficCounters& c = g_can_traffic[bus];
+    CanTraffic t;
+    t.tx_frames = c.tx_frames.load(std::memory_order_relaxed);
+    t.tx_bits = c.tx_bits.load(std::memory_order_relaxed);
+    t.rx_frames = c.rx_frames.load(std::memory_order_relaxed);
+    t.rx_bits = c.rx_bits.load(std::memory_order_relaxed);
+    t.rx_bytes = c.rx_bytes.load(std::memory_order_relaxed);
+    return t;
+}
+
+// from から to までにバスから受信したビット数．can_rx が見ていない分は見積もりで足す．
+inline double can_traffic_rx_bits(const CanTraffic& from, const CanTraffic& to) {
+    double bits = static_cast<double>(to.rx_bits - from.rx_bits);
+    // インタフェースを上げ直すと統計は 0 に戻る.
+    if (!from.has_if_stats || !to.has_if_stats || to.if_rx_frames < from.if_rx_frames) {
+        return bits;
+    }
+    const uint64_t if_frames = to.if_rx_frames - from.if_rx_frames;
+    const uint64_t if_bytes = to.if_rx_bytes - from.if_rx_bytes;
+    const uint64_t seen_frames = to.rx_frames - from.rx_frames;
+    const uint64_t seen_bytes = to.rx_bytes - from.rx_bytes;
+    if (if_frames > seen_frames) {
+        const auto frames = static_cast<double>(if_frames - seen_frames);
+        const auto bytes = static_cast<double>(if_bytes > seen_bytes ? if_bytes - seen_bytes : 0);
+        bits += (frames * CAN_SFF_STUFFABLE_OVERHEAD_BITS + bytes * 8.0) * (1.0 + CAN_UNSEEN_STUFF_RATIO)
+              + frames * CAN_FIXED_TAIL_BITS;
+    }
+    return bits;
+}
+
+// from から to までにバスから受信したフレーム数．
+inline uint64_t can_traffic_rx_frames(const CanTraffic& from, const CanTraffic& to) {
+    const uint64_t seen = to.rx_frames - from.rx_frames;
+    if (!from.has_if_stats || !to.has_if_stats || to.if_rx_frames < from.if_rx_frames) {
+        return seen;
+    }
+    return std::max(seen, to.if_rx_frames - from.if_rx_frames);
+}
+
+// 1 つのインタフェースの累計を一定時間ごとに読み，区間ごとの使用率と，Reset() からの平均・最大を求める．
+// 1 スレッドからだけ使うこと．
+class CanBusLoadMeter final {
+public:
+    explicit CanBusLoadMeter(const double window_sec = 1.0, const uint32_t bitrate = CAN_BITRATE)
+        : window_sec_(window_sec), bitrate_(bitrate) {}
+
+    // 統計のファイルはインタフェースが変わったときだけ開き直す.
+    void Reset(const size_t bus, const double now) {
+        if (!if_opened_ || bus != bus_) {
+            if_stats_.Open(can_bus_name(bus));
+            if_opened_ = true;
+        }
+        bus_ = bus;
+        start_time_ = window_time_ = now;
+        start_ = window_ = Snapshot();
+        peak_ = 0.0;
+        last_ = 0.0;
+    }
+
+    // 前回から window_sec 以上経っていれば区間を締めて true を返す．LastLoad() がその区間の使用率.
+    bool Sample(const double now) {
+        const double dt = now - window_time_;
+        if (dt < window_sec_) {
+            return false;
+        }
+        const CanTraffic t = Snapshot();
+        last_ = LoadOf(window_, t, dt);
+        peak_ = std::max(peak_, last_);
+        window_ = t;
+        window_time_ = now;
+        return true;
+    }
+
+    double LastLoad() const { return last_; }
+    double PeakLoad() const { return peak_; }
+
+    void Print(std::ostream& os, const char* prefix, const double now) const {
+        const double dt = now - start_time_;
+        if (dt <= 0.0) {
+            return;
+        }
+        const CanTraffic t = Snapshot();
+        os << prefix << std::fixed << std::setprecision(1)
+           << " avg " << LoadOf(start_, t, dt) * 100.0 << "%"
+           << " (tx " << static_cast<double>(t.tx_bits - start_.tx_bits) / dt * 1e-3 << " kbit/s "
+           << (t.tx_frames - start_.tx_frames) << " frames,"
+           << " rx " << can_traffic_rx_bits(start_, t) / dt * 1e-3 << " kbit/s "
+           << can_traffic_rx_frames(start_, t) << " frames"
+           << (t.has_if_stats ? "" : " gateway only") << ")"
+           << " peak " << peak_ * 100.0 << "% / " << window_sec_ << " s"
+           << std::defaultfloat << std::endl;
+    }
+
+private:
+    CanTraffic Snapshot() const {
+        CanTraffic t = can_traffic_snapshot(bus_);
+        t.has_if_stats = if_stats_.Read(t.if_rx_frames, t.if_rx_bytes);
+        return t;
+    }
+
+    double LoadOf(const CanTraffic& from, const CanTraffic& to, const double dt) const {
+        const double bits = static_cast<double>(to.tx_bits - from.tx_bits) + can_traffic_rx_bits(from, to);
+        return bits / dt / static_cast<double>(bitrate_);
+    }
+
+    double window_sec_;
+    uint32_t bitrate_;
+    size_t bus_ = 0;
+    CanIfRxStats if_stats_;
+    bool if_opened_ = false;
+
+    double start_time_ = 0.0;
+    double window_time_ = 0.0;
+    CanTraffic start_;
+    CanTraffic window_;
+    double peak_ = 0.0;
+    double last_ = 0.0;
+};
@@ -0,0 +1,258 @@
+#include "can_rx.h"
+
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "can_bus_load.h"
+#include "can_topology.h"
+#include "time_utils.h"
+
+namespace {
+constexpr int kPollTimeoutMs = 100;  // 停止要求を確認する間隔.
+constexpr uint8_t kNoHandler = 0xFF;
+
+struct Registration {
+    uint32_t id;
+    uint32_t mask;
+    CanRxHandler handler;
+    int bus;  // CAN_RX_ANY_BUS なら全インタフェース.
+};
+
+std::vector<Registration> registrations;
+
+// インタフェースごとの受信ソケットと振り分け表．
+struct RxBus {
+    size_t index = 0;
+    int sock = -1;
+    std::thread thread;
+    // 11bit の標準 ID ごとに，担当する registrations の添字を引く表．
+    std::array<uint8_t, CAN_SFF_MASK + 1> id_table{};
+};
+
+std::array<RxBus, CAN_MAX_BUSES> buses;
+bool opened = false;
+std::atomic<bool> running{false};
+
+bool serves(const Registration& r, const size_t bus) {
+    return r.bus == CAN_RX_ANY_BUS || static_cast<size_t>(r.bus) == bus;
+}
+
+void build_id_table(RxBus& bus) {
+    bus.id_table.fill(kNoHandler);
+    for (uint32_t id = 0; id <= CAN_SFF_MASK; ++id) {
+        for (size_t i = 0; i < registrations.size(); ++i) {
+            const auto& r = registrations[i];
+            if (serves(r, bus.index) && (id & r.mask) == (r.id & r.mask)) {
+                bus.id_table[id] = static_cast<uint8_t>(i);
+                break;
+            }
+        }
+    }
+}
+
+int open_rx_socket(const size_t bus) {
+    const char* ifname = can_bus_name(bus);
+    int s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (s < 0) {
+        std::cerr << "[CANRX] socket(PF_CAN) failed (" << ifname << ")" << std::endl;
+        return -1;
+    }
+
+    // 受信時刻をカーネルに記録させる．recvmsg() の補助データで受け取る.
+    const int on = 1;
+    if (setsockopt(s, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+        std::cerr << "[CANRX] setsockopt(SO_TIMESTAMPNS) failed, using receive time" << std::endl;
+    }
+
+    // 標準フレームかつ非 RTR のものだけを通す.
+    std::vector<can_filter> filters;
+    filters.reserve(registrations.size());
+    for (const auto& r : registrations) {
+        if (!serves(r, bus)) {
+            continue;
+        }
+        can_filter f{};
+        f.can_id   = r.id & CAN_SFF_MASK;
+        f.can_mask = (r.mask & CAN_SFF_MASK) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+        filters.push_back(f);
+    }
+    if (setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, filters.data(),
+                   filters.size() * sizeof(can_filter)) < 0) {
+        std::cerr << "[CANRX] setsockopt(CAN_RAW_FILTER) failed (" << ifname << ")" << std::endl;
+        close(s);
+        return -1;
+    }
+
+    ifreq ifr{};
+    std::strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+        std::cerr << "[CANRX] ioctl(SIOCGIFINDEX) failed (" << ifname << ")" << std::endl;
+        close(s);
+        return -1;
+    }
+
+    sockaddr_can addr{};
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(s, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        std::cerr << "[CANRX] bind(CAN) failed (" << ifname << ")" << std::endl;
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+double rx_time_of(msghdr& msg) {
+    for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec ts{};
+            std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            return realtime_to_time_sec(ts);
+        }
+    }
+    return now_time_sec();
+}
+
+// bus のソケットに届いているフレームをすべて読み，ハンドラに振り分ける.
+void drain(const RxBus& bus) {
+    for (;;) {
+        can_frame frame{};
+        iovec iov{&frame, sizeof(frame)};
+        alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(timespec))];
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        const ssize_t n = recvmsg(bus.sock, &msg, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "[CANRX] recv(CAN) failed" << std::endl;
+            }
+            break;
+        }
+        if (n < static_cast<ssize_t>(sizeof(frame))) {
+            break;
+        }
+        if (frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)) {
+            continue;
+        }
+        can_traffic_record_rx(bus.index, frame);
+
+        const uint8_t idx = bus.id_table[frame.can_id & CAN_SFF_MASK];
+        if (idx != kNoHandler) {
+            registrations[idx].handler(frame, rx_time_of(msg));
+        }
+    }
+}
+
+void rx_loop(const RxBus& bus) {
+    pollfd pfd{};
+    pfd.fd = bus.sock;
+    pfd.events = POLLIN;
+
+    while (running) {
+        const int ready = poll(&pfd, 1, kPollTimeoutMs);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "[CANRX] poll() failed" << std::endl;
+            break;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        drain(bus);
+    }
+}
+}  // namespace
+
+void can_rx_register(const uint32_t id, const uint32_t mask, CanRxHandler handler, const int bus) {
+    if (opened) {
+        std::cerr << "[CANRX] register after start is ignored" << std::endl;
+        return;
+    }
+    if (registrations.size() >= kNoHandler) {
+        std::cerr << "[CANRX] too many handlers" << std::endl;
+        return;
+    }
+    // 先に登録したものと重なる ID は，このハンドラには渡らない．意図しない重なりは見落としやすいので知らせる.
+    for (const auto& r : registrations) {
+        const bool same_bus = r.bus == CAN_RX_ANY_BUS || bus == CAN_RX_ANY_BUS || r.bus == bus;
+        if (same_bus && ((r.id ^ id) & r.mask & mask & CAN_SFF_MASK) == 0) {
+            std::cerr << "[CANRX] 0x" << std::hex << id << "/0x" << mask << " overlaps 0x" << r.id << "/0x"
+                      << r.mask << std::dec << ", frames in both go to the earlier handler" << std::endl;
+        }
+    }
+    registrations.push_back({id, mask, std::move(handler), bus});
+}
+
+std::vector<int> can_rx_open() {
+    opened = true;
+    std::vector<int> fds;
+    for (size_t i = 0; i < can_bus_count(); ++i) {
+        RxBus& bus = buses[i];
+        bus.index = i;
+        build_id_table(bus);
+        bus.sock = open_rx_socket(i);
+        fds.push_back(bus.sock);
+        if (bus.sock >= 0) {
+            std::cout << "[CANRX] start / CAN受信開始 (" << can_bus_name(i) << ", "
+                      << registrations.size() << " handlers)." << std::endl;
+        }
+    }
+    return fds;
+}
+
+void can_rx_on_readable(const size_t bus) {
+    drain(buses[bus]);
+}
+
+void can_rx_close() {
+    for (auto& bus : buses) {
+        if (bus.sock >= 0) {
+            close(bus.sock);
+            bus.sock = -1;
+        }
+    }
+}
+
+bool can_rx_start() {
+    bool ok = true;
+    running = true;
+    for (const int fd : can_rx_open()) {
+        ok = ok && fd >= 0;
+    }
+    for (size_t i = 0; i < can_bus_count(); ++i) {
+        if (buses[i].sock >= 0) {
+            buses[i].thread = std::thread(rx_loop, std::cref(buses[i]));
+        }
+    }
+    return ok;
+}
+
+void can_rx_stop() {
+    running = false;
+    for (auto& bus : buses) {
+        if (bus.thread.joinable()) {
+            bus.thread.join();
+        }
+    }
+    can_rx_close();
+    std::cout << "[CANRX] stopped / 終了しました." << std::endl;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <linux/can.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// CAN の受信側をまとめて受け持つモジュール．
+// インタフェース (can_topology.h) ごとに受信用ソケットを 1 本ずつ開き，登録された ID 範囲をカーネルの
+// CAN_RAW_FILTER で絞り込んだうえで，ID → ハンドラの表を引いて振り分ける．
+// 各モジュールが個別に生ソケットを開くと，全フレームがソケットの数だけ
+// コピーされてしまうので，受信はここに集約すること．
+
+// 受信フレームを処理するハンドラ．受信スレッド上で呼ばれるので，重い処理はしないこと．
+// スレッドモードではインタフェースごとに受信スレッドがあるので，CAN_RX_ANY_BUS で登録したハンドラは
+// 複数のスレッドから同時に呼ばれうる．
+// rx_time はカーネルがフレームを受け取った時刻 (SO_TIMESTAMPNS) を now_time_sec() の基準に直したもの．
+// タイムスタンプが取れなかった場合は，受信処理時の now_time_sec() になる．
+using CanRxHandler = std::function<void(const can_frame& frame, double rx_time)>;
+
+constexpr int CAN_RX_ANY_BUS = -1;
+
+// (can_id & mask) == (id & mask) となる標準フレームを handler に渡すよう登録する．
+// bus を指定すると，そのインタフェースで受けたフレームだけを渡す (ほかのインタフェースではフィルタも設定しない)．
+// 複数の登録に当てはまる ID は，先に登録したハンドラに渡る (重なる登録をすると警告を表示する)．
+// cmd だけを見るマスク (0x1F) は Pico の応答 (0x301 ..) と重なることがある (0x001 など)．その場合はノードごとの ID で登録すること．
+// can_set_topology() の後，can_rx_start() より前に呼ぶこと．
+void can_rx_register(uint32_t id, uint32_t mask, CanRxHandler handler, int bus = CAN_RX_ANY_BUS);
+
+// 全インタフェースの受信ソケットを開いてフィルタを設定し，インタフェースごとに受信スレッドを起動する．
+// 開けなかったインタフェースがあれば false (開けたものは動かす)．
+bool can_rx_start();
+
+// 受信スレッドを停止してソケットを閉じる．以後ハンドラは呼ばれない．
+void can_rx_stop();
+
+// ===== リアクタモード用 (reactor.h) =====
+// 受信スレッドを起動せず，呼び出し側のイベントループでソケットを監視する場合に使う．
+
+// 全インタフェースの受信ソケットを開いてフィルタを設定し，その fd を返す (index はインタフェースの番号)．
+// 開けなかったインタフェースは -1．
+std::vector<int> can_rx_open();
+
+// bus の受信ソケットが読み出し可能になったときに呼ぶ．届いているフレームをすべて振り分ける．
+void can_rx_on_readable(size_t bus);
+
+// can_rx_open() で開いたソケットを閉じる．
+void can_rx_close();
@@ -0,0 +1,157 @@
+#include "can_topology.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "global_variable.h"
+
+namespace {
+CanTopology topology;
+
+// "1-12" / "3" / "1-3+7" を node_id の集合として解釈する.
+bool parse_nodes(const std::string& text, std::vector<int>& out) {
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        const size_t end = std::min(text.find('+', pos), text.size());
+        const std::string range = text.substr(pos, end - pos);
+        char* p = nullptr;
+        const long first = std::strtol(range.c_str(), &p, 10);
+        long last = first;
+        if (p == range.c_str()) {
+            return false;
+        }
+        if (*p == '-') {
+            const char* q = p + 1;
+            last = std::strtol(q, &p, 10);
+            if (p == q) {
+                return false;
+            }
+        }
+        if (*p != '\0' || first < 1 || last > CAN_MAX_NODE_ID || first > last) {
+            return false;
+        }
+        for (long id = first; id <= last; ++id) {
+            out.push_back(static_cast<int>(id));
+        }
+        pos = end + 1;
+    }
+    return true;
+}
+
+int find_or_add(CanTopology& t, const std::string& name) {
+    for (size_t i = 0; i < t.interfaces.size(); ++i) {
+        if (t.interfaces[i] == name) {
+            return static_cast<int>(i);
+        }
+    }
+    if (t.interfaces.size() >= CAN_MAX_BUSES) {
+        return -1;
+    }
+    t.interfaces.push_back(name);
+    return static_cast<int>(t.interfaces.size() - 1);
+}
+}  // namespace
+
+bool parse_can_topology(const char* bus_text, const char* pico_text, CanTopology& out) {
+    CanTopology t;
+    if (bus_text != nullptr) {
+        t.interfaces.clear();
+        const std::string text(bus_text);
+        size_t pos = 0;
+        while (pos <= text.size()) {
+            const size_t end = std::min(text.find(',', pos), text.size());
+            const std::string item = text.substr(pos, end - pos);
+            const size_t colon = item.find(':');
+            const std::string name = item.substr(0, colon);
+            if (name.empty()) {
+                std::cerr << "[CAN] empty interface name in --can-bus" << std::endl;
+                return false;
+            }
+            const int bus = find_or_add(t, name);
+            if (bus < 0) {
+                std::cerr << "[CAN] too many interfaces (max " << CAN_MAX_BUSES << ")" << std::endl;
+                return false;
+            }
+            if (colon != std::string::npos) {
+                std::vector<int> nodes;
+                if (!parse_nodes(item.substr(colon + 1), nodes)) {
+                    std::cerr << "[CAN] invalid node range: " << item << std::endl;
+                    return false;
+                }
+                for (const int id : nodes) {
+                    t.node_bus[id - 1] = static_cast<uint8_t>(bus);
+                }
+            }
+            pos = end + 1;
+        }
+    }
+    if (pico_text != nullptr) {
+        const int bus = find_or_add(t, pico_text);
+        if (bus < 0) {
+            std::cerr << "[CAN] too many interfaces (max " << CAN_MAX_BUSES << ")" << std::endl;
+            return false;
+        }
+        t.pico_bus = static_cast<uint8_t>(bus);
+    }
+    out = t;
+    return true;
+}
+
+void can_set_topology(const CanTopology& t) {
+    topology = t;
+}
+
+size_t can_bus_count() {
+    return topology.interfaces.size();
+}
+
+const char* can_bus_name(const size_t bus) {
+    return topology.interfaces[bus].c_str();
+}
+
+size_t can_bus_of_node(const int node_id) {
+    if (node_id < 1 || node_id > CAN_MAX_NODE_ID) {
+        return 0;
+    }
+    return topology.node_bus[node_id - 1];
+}
+
+uint32_t can_bus_node_mask(const size_t bus) {
+    uint32_t mask = 0;
+    for (int i = 0; i < CAN_MAX_NODE_ID; ++i) {
+        if (topology.node_bus[i] == bus) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+size_t can_pico_bus() {
+    return topology.pico_bus;
+}
+
+void can_topology_print() {
+    for (size_t bus = 0; bus < topology.interfaces.size(); ++bus) {
+        std::cout << "[CAN] " << topology.interfaces[bus] << ": nodes";
+        // 連続する node_id はまとめて表示する.
+        int first = 0;
+        for (int id = 1; id <= NUM_ODRIVE + 1; ++id) {
+            const bool on_bus = (id <= NUM_ODRIVE) && topology.node_bus[id - 1] == bus;
+            if (on_bus && first == 0) {
+                first = id;
+            } else if (!on_bus && first != 0) {
+                std::cout << " " << first;
+                if (id - 1 > first) {
+                    std::cout << "-" << (id - 1);
+                }
+                first = 0;
+            }
+        }
+        if (topology.pico_bus == bus) {
+            std::cout << ", pico";
+        }
+        std::cout << std::endl;
+    }
+}
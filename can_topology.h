@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// どの ODrive (node_id) と Pico がどの CAN インタフェースにつながっているか．
+// インタフェースごとに送信スレッド (can_tx.h) と受信スレッド (can_rx.h) を 1 本ずつ動かす．
+// 既定は全ノード・全 Pico が can0．--can-bus を指定すると，この既定を丸ごと置き換える
+// (指定したインタフェースだけを使う)．CAN の配線はこのオプションだけで決め，robot_topology.h には持たない．
+//
+// 起動オプション (main.cpp) の書式:
+//   --can-bus=can0:1-12,can1:13-16   (IF:node_id の範囲．範囲は "a-b" か "a" を "+" でつなげてもよい)
+//   --pico-bus=can0                  (Pico の応答が届くインタフェース)
+// どの範囲にも入らないノードは先頭のインタフェースに割り当てる．vcan でもそのまま動く．
+
+constexpr size_t CAN_MAX_BUSES = 4;
+constexpr int CAN_MAX_NODE_ID = 32;  // CAN_MAX_BATCH_NODES (can_utils.h) と同じ.
+
+// parse_can_topology() で作ること．
+struct CanTopology {
+    std::vector<std::string> interfaces{"can0"};
+    std::vector<uint8_t> node_bus = std::vector<uint8_t>(CAN_MAX_NODE_ID, 0);  // index は node_id - 1．
+    uint8_t pico_bus = 0;
+};
+
+// オプションの値から topology を作る．bus_text が nullptr なら既定 (全ノード can0)，
+// pico_text が nullptr なら Pico は先頭のインタフェース．
+// 解釈できなければ理由を表示して false．
+bool parse_can_topology(const char* bus_text, const char* pico_text, CanTopology& out);
+
+// can_init() / can_rx の開始より前に呼ぶこと．
+void can_set_topology(const CanTopology& topology);
+
+size_t can_bus_count();
+const char* can_bus_name(size_t bus);
+
+// node_id (1..CAN_MAX_NODE_ID) がつながっているインタフェースの番号．範囲外なら 0．
+size_t can_bus_of_node(int node_id);
+
+// bus につながっているノードのマスク (bit i が node_id = i + 1)．
+uint32_t can_bus_node_mask(size_t bus);
+
+size_t can_pico_bus();
+
+// 割り当てを表示する．
+void can_topology_print();
@@ -0,0 +1,402 @@
+#include "can_tx.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "can_bus_load.h"
+#include "can_topology.h"
+#include "latency_histogram.h"
+#include "thread_priority.h"
+#include "time_utils.h"
+
+namespace {
+constexpr size_t kMaxNodes = 32;              // 位置指令を置き換えるノード数の上限 (node_id 1..32)．
+constexpr size_t kSafetyCapacity = 64;
+constexpr size_t kHousekeepingCapacity = 256;
+constexpr int kTxPriority = 90;               // ☆ 送信スレッドの SCHED_FIFO 優先度 (周期送信スレッドより上)．
+constexpr int kSendBufferBytes = 4096;        // ☆ SO_SNDBUF．カーネル内で送信待ちになるフレーム数がこれで決まる.
+constexpr int kEnobufsBackoffMs = 1;          // ENOBUFS のときに送り直すまで待つ時間.
+constexpr int kWaitTimeoutMs = 100;           // 停止要求を確認する間隔.
+constexpr double kErrorLogInterval = 1.0;     // 送信エラーを表示する最短の間隔 [sec].
+
+struct Pending {
+    can_frame frame;
+    double time;  // 積んだ時刻.
+};
+
+// 固定容量の FIFO．mutex の中で使う.
+template<size_t Capacity>
+class FrameQueue final {
+public:
+    bool Push(const Pending& p) {
+        if (size_ == Capacity) {
+            return false;
+        }
+        items_[(head_ + size_) % Capacity] = p;
+        ++size_;
+        return true;
+    }
+    bool Empty() const { return size_ == 0; }
+    size_t Size() const { return size_; }
+    const Pending& Front() const { return items_[head_]; }
+    void Pop() {
+        head_ = (head_ + 1) % Capacity;
+        --size_;
+    }
+
+private:
+    std::array<Pending, Capacity> items_{};
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+// インタフェース 1 つ分の待ち行列と送信スレッド．インタフェースどうしは何も共有しない.
+struct TxBus {
+    size_t index = 0;
+
+    std::mutex queue_mutex;
+    FrameQueue<kSafetyCapacity> safety_queue;
+    FrameQueue<kHousekeepingCapacity> housekeeping_queue;
+    std::array<Pending, kMaxNodes> setpoint_slots{};
+    uint32_t pending_setpoints = 0;  // bit i: setpoint_slots[i] が未送信.
+
+    // 積む側が数える統計 (queue_mutex の中で書く)．
+    uint64_t replaced_setpoints = 0;  // 未送信のうちに新しい指令で置き換えた位置指令.
+    uint64_t overflow_drops = 0;      // 待ち行列があふれて捨てたフレーム.
+
+    // 送信スレッドだけが書く統計．停止後に表示する.
+    std::array<uint64_t, 3> sent_frames{};
+    uint64_t retries = 0;      // EAGAIN / ENOBUFS で待ってから送り直した回数.
+    uint64_t error_drops = 0;  // それ以外のエラーで捨てたフレーム.
+    uint64_t stop_drops = 0;   // 停止時に送り切れなかったフレーム.
+    LatencyHistogram safety_latency;    // 積んでから書き込めるまで [ns].
+    LatencyHistogram setpoint_latency;
+
+    int sock = -1;
+    int wake_fd = -1;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    double last_error_log = -kErrorLogInterval;
+};
+
+std::array<TxBus, CAN_MAX_BUSES> buses;
+std::atomic<double> flush_deadline{0.0};
+std::atomic<uint32_t> dropped_setpoints{0};  // can_tx_take_dropped_setpoints() が返すマスク.
+
+void mark_dropped(const uint32_t mask) {
+    if (mask != 0) {
+        dropped_setpoints.fetch_or(mask, std::memory_order_relaxed);
+    }
+}
+
+int node_index_of(const can_frame& frame) {
+    const int node_id = static_cast<int>((frame.can_id >> 5) & 0x3F);
+    return (node_id >= 1 && node_id <= static_cast<int>(kMaxNodes)) ? node_id - 1 : -1;
+}
+
+void wake(TxBus& bus) {
+    const uint64_t one = 1;
+    [[maybe_unused]] auto _ = write(bus.wake_fd, &one, sizeof(one));
+}
+
+// wake_fd (と，writable なら送信ソケットの書き込み可能) を最大 timeout_ms 待つ.
+void wait_for(TxBus& bus, const bool writable, const int timeout_ms) {
+    pollfd fds[2]{};
+    fds[0].fd = bus.wake_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = bus.sock;
+    fds[1].events = POLLOUT;
+    if (poll(fds, writable ? 2 : 1, timeout_ms) > 0 && (fds[0].revents & POLLIN)) {
+        uint64_t count = 0;
+        [[maybe_unused]] auto _ = read(bus.wake_fd, &count, sizeof(count));
+    }
+}
+
+void log_error(TxBus& bus, const int error) {
+    const double now = now_time_sec();
+    if (now - bus.last_error_log >= kErrorLogInterval) {
+        std::cerr << "[CANTX " << can_bus_name(bus.index) << "] send failed: " << std::strerror(error) << std::endl;
+        bus.last_error_log = now;
+    }
+}
+
+// 送信の失敗を処理する．送り直すなら true，捨てるなら false.
+bool handle_send_error(TxBus& bus, const int error) {
+    if (error == EINTR) {
+        return true;
+    }
+    if (error == EAGAIN || error == EWOULDBLOCK) {
+        // 送信バッファが空くまで待つ．新しい指令が積まれても起きて優先度を見直す.
+        ++bus.retries;
+        wait_for(bus, true, kWaitTimeoutMs);
+        return true;
+    }
+    if (error == ENOBUFS) {
+        // デバイスの送信キューが一杯．poll() で空きは分からないので少し待つ.
+        ++bus.retries;
+        wait_for(bus, false, kEnobufsBackoffMs);
+        return true;
+    }
+    log_error(bus, error);
+    return false;
+}
+
+// 単発の待ち行列の先頭を 1 フレーム送る．
+template<size_t Capacity>
+void send_front(TxBus& bus, FrameQueue<Capacity>& queue, const CanTxClass cls, LatencyHistogram* latency) {
+    Pending p{};
+    {
+        std::lock_guard<std::mutex> lock(bus.queue_mutex);
+        p = queue.Front();
+    }
+
+    // 先頭を取り出すのはこのスレッドだけなので，送れたら Pop() してよい.
+    if (write(bus.sock, &p.frame, sizeof(p.frame)) == static_cast<ssize_t>(sizeof(p.frame))) {
+        can_traffic_record_tx(bus.index, p.frame);
+        ++bus.sent_frames[static_cast<size_t>(cls)];
+        if (latency != nullptr) {
+            latency->Record(static_cast<uint64_t>((now_time_sec() - p.time) * 1e9));
+        }
+    } else if (handle_send_error(bus, errno)) {
+        return;
+    } else {
+        ++bus.error_drops;
+    }
+    std::lock_guard<std::mutex> lock(bus.queue_mutex);
+    queue.Pop();
+}
+
+// 未送信の位置指令をまとめて sendmmsg() で送る．送れなかったものは，置き換えられていなければ戻す.
+void send_setpoints(TxBus& bus, uint32_t mask) {
+    std::array<Pending, kMaxNodes> batch{};
+    std::array<size_t, kMaxNodes> nodes{};
+    std::array<iovec, kMaxNodes> iov{};
+    std::array<mmsghdr, kMaxNodes> msgs{};
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(bus.queue_mutex);
+        mask &= bus.pending_setpoints;
+        for (uint32_t m = mask; m != 0; m &= m - 1) {
+            const auto i = static_cast<size_t>(__builtin_ctz(m));
+            batch[count] = bus.setpoint_slots[i];
+            nodes[count] = i;
+            ++count;
+        }
+        bus.pending_setpoints &= ~mask;
+    }
+    for (size_t k = 0; k < count; ++k) {
+        iov[k] = {&batch[k].frame, sizeof(can_frame)};
+        msgs[k].msg_hdr.msg_iov = &iov[k];
+        msgs[k].msg_hdr.msg_iovlen = 1;
+    }
+
+    const int r = sendmmsg(bus.sock, msgs.data(), static_cast<unsigned>(count), 0);
+    const int error = errno;
+    const size_t sent = (r > 0) ? static_cast<size_t>(r) : 0;
+    const double now = now_time_sec();
+    for (size_t k = 0; k < sent; ++k) {
+        can_traffic_record_tx(bus.index, batch[k].frame);
+        bus.setpoint_latency.Record(static_cast<uint64_t>((now - batch[k].time) * 1e9));
+    }
+    bus.sent_frames[static_cast<size_t>(CanTxClass::kSetpoint)] += sent;
+    if (sent == count) {
+        return;
+    }
+
+    // sendmmsg() は途中で失敗すると送れた分だけを返し，エラーは次の呼び出しで返る.
+    const bool retry = (r > 0) || handle_send_error(bus, error);
+    std::lock_guard<std::mutex> lock(bus.queue_mutex);
+    for (size_t k = sent; k < count; ++k) {
+        const uint32_t bit = 1u << nodes[k];
+        if (bus.pending_setpoints & bit) {
+            ++bus.replaced_setpoints;  // 待っている間に新しい指令が来た.
+        } else if (retry) {
+            bus.setpoint_slots[nodes[k]] = batch[k];
+            bus.pending_setpoints |= bit;
+        } else {
+            ++bus.error_drops;
+            mark_dropped(bit);
+        }
+    }
+}
+
+void tx_loop(TxBus& bus) {
+    set_fifo_priority(kTxPriority);
+
+    for (;;) {
+        bool has_safety = false;
+        bool has_housekeeping = false;
+        uint32_t setpoints = 0;
+        {
+            std::lock_guard<std::mutex> lock(bus.queue_mutex);
+            has_safety = !bus.safety_queue.Empty();
+            setpoints = bus.pending_setpoints;
+            has_housekeeping = !bus.housekeeping_queue.Empty();
+        }
+
+        if (!bus.running && (now_time_sec() >= flush_deadline || (!has_safety && !setpoints && !has_housekeeping))) {
+            std::lock_guard<std::mutex> lock(bus.queue_mutex);
+            bus.stop_drops += bus.safety_queue.Size() + bus.housekeeping_queue.Size()
+                            + static_cast<uint64_t>(__builtin_popcount(bus.pending_setpoints));
+            mark_dropped(bus.pending_setpoints);
+            bus.pending_setpoints = 0;
+            break;
+        }
+
+        // 1 回に送るのは 1 種類だけにして，送るたびに優先度の高いものから見直す.
+        if (has_safety) {
+            send_front(bus, bus.safety_queue, CanTxClass::kSafety, &bus.safety_latency);
+        } else if (setpoints != 0) {
+            send_setpoints(bus, setpoints);
+        } else if (has_housekeeping) {
+            send_front(bus, bus.housekeeping_queue, CanTxClass::kHousekeeping, nullptr);
+        } else {
+            wait_for(bus, false, kWaitTimeoutMs);
+        }
+    }
+}
+
+void print_stats(const TxBus& bus) {
+    const std::string prefix = std::string("[CANTX ") + can_bus_name(bus.index) + "]";
+    std::cout << prefix << " sent safety=" << bus.sent_frames[0] << " setpoint=" << bus.sent_frames[1]
+              << " housekeeping=" << bus.sent_frames[2] << " replaced=" << bus.replaced_setpoints
+              << " retries=" << bus.retries << " dropped: overflow=" << bus.overflow_drops
+              << " error=" << bus.error_drops << " stop=" << bus.stop_drops << std::endl;
+    if (bus.safety_latency.Count() > 0) {
+        bus.safety_latency.Print(std::cout, (prefix + " safety queue -> write:").c_str(), "us", 1e-3);
+    }
+    if (bus.setpoint_latency.Count() > 0) {
+        bus.setpoint_latency.Print(std::cout, (prefix + " setpoint queue -> write:").c_str(), "us", 1e-3);
+    }
+}
+}  // namespace
+
+void can_tx_start(const size_t index, const int sock) {
+    TxBus& bus = buses[index];
+    bus.index = index;
+    bus.sock = sock;
+    bus.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (bus.wake_fd < 0) {
+        std::cerr << "[CANTX] eventfd() failed" << std::endl;
+        return;
+    }
+
+    // カーネル内の送信待ちを短く保つ．一杯になると write() が EAGAIN を返すので，ここで優先度を付け直せる.
+    const int sndbuf = kSendBufferBytes;
+    if (setsockopt(bus.sock, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) < 0) {
+        std::cerr << "[CANTX] setsockopt(SO_SNDBUF) failed (" << can_bus_name(index) << ")" << std::endl;
+    }
+
+    bus.running = true;
+    bus.thread = std::thread(tx_loop, std::ref(bus));
+}
+
+void can_tx_stop(const double flush_timeout_sec) {
+    // 全インタフェースに同時に停止を伝え，送り切るのを並行して待つ.
+    flush_deadline = now_time_sec() + flush_timeout_sec;
+    for (auto& bus : buses) {
+        if (bus.thread.joinable()) {
+            bus.running = false;
+            wake(bus);
+        }
+    }
+    for (auto& bus : buses) {
+        if (!bus.thread.joinable()) {
+            continue;
+        }
+        bus.thread.join();
+        close(bus.wake_fd);
+        bus.wake_fd = -1;
+        print_stats(bus);
+    }
+}
+
+bool can_tx_submit(const size_t index, const can_frame& frame, const CanTxClass cls) {
+    TxBus& bus = buses[index];
+    if (!bus.running) {
+        const int node = node_index_of(frame);
+        if (cls == CanTxClass::kSetpoint && node >= 0) {
+            mark_dropped(1u << node);
+        }
+        return false;
+    }
+    const Pending p{frame, now_time_sec()};
+    {
+        std::lock_guard<std::mutex> lock(bus.queue_mutex);
+        bool ok = true;
+        const int node = node_index_of(frame);
+        switch (cls) {
+        case CanTxClass::kSafety:
+            ok = bus.safety_queue.Push(p);
+            if (ok && node >= 0 && (bus.pending_setpoints & (1u << node))) {
+                bus.pending_setpoints &= ~(1u << node);
+                ++bus.replaced_setpoints;
+                mark_dropped(1u << node);
+            }
+            break;
+        case CanTxClass::kSetpoint:
+            if (node < 0) {
+                ok = bus.housekeeping_queue.Push(p);
+                break;
+            }
+            if (bus.pending_setpoints & (1u << node)) {
+                ++bus.replaced_setpoints;
+            }
+            bus.setpoint_slots[node] = p;
+            bus.pending_setpoints |= 1u << node;
+            break;
+        case CanTxClass::kHousekeeping:
+            ok = bus.housekeeping_queue.Push(p);
+            break;
+        }
+        if (!ok) {
+            ++bus.overflow_drops;
+            return false;
+        }
+    }
+    wake(bus);
+    return true;
+}
+
+void can_tx_submit_setpoints(const can_frame* frames, const uint32_t mask) {
+    if (mask == 0) {
+        return;
+    }
+    const double now = now_time_sec();
+    for (size_t index = 0; index < can_bus_count(); ++index) {
+        TxBus& bus = buses[index];
+        const uint32_t bus_mask = mask & can_bus_node_mask(index);
+        if (bus_mask == 0) {
+            continue;
+        }
+        if (!bus.running) {
+            mark_dropped(bus_mask);
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(bus.queue_mutex);
+            bus.replaced_setpoints += static_cast<uint64_t>(__builtin_popcount(bus.pending_setpoints & bus_mask));
+            for (uint32_t m = bus_mask; m != 0; m &= m - 1) {
+                const auto i = static_cast<size_t>(__builtin_ctz(m));
+                bus.setpoint_slots[i] = {frames[i], now};
+            }
+            bus.pending_setpoints |= bus_mask;
+        }
+        wake(bus);
+    }
+}
+
+uint32_t can_tx_take_dropped_setpoints() {
+    return dropped_setpoints.exchange(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <linux/can.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// CAN の送信側をまとめて受け持つスケジューラ．
+// インタフェース (can_topology.h) ごとに待ち行列と送信スレッドを 1 本ずつ持ち，並行して送る．
+// 送信したいフレームは優先度別に積み，そのインタフェースの送信スレッドだけがソケットに書く．
+//
+//   kSafety       : 状態遷移・停止などの指令．最優先．あふれない限り捨てない.
+//   kSetpoint     : 位置指令．ノードごとに最新の 1 フレームだけを持ち，未送信のうちに
+//                   新しい指令が来たら置き換える (古い指令を順番に送り切る意味はない).
+//   kHousekeeping : それ以外．一番後回し.
+//
+// ソケットの送信バッファを小さくしてカーネル内の送信待ちを数フレームに抑えるので，
+// 停止指令が何百もの古い位置指令の後ろに並ぶことはない．
+// 送信バッファが一杯 (EAGAIN) なら poll() で空くのを待ち，ENOBUFS なら少し待って送り直す．
+// 送れた・置き換えた・捨てた・再試行した数を数え，停止時に表示する．
+
+enum class CanTxClass {
+    kSafety,
+    kSetpoint,
+    kHousekeeping,
+};
+
+// インタフェース bus の送信用 CAN_RAW ソケット sock を使って送信スレッドを起動する．can_init() から呼ばれる.
+void can_tx_start(size_t bus, int sock);
+
+// 積んである状態遷移・停止の指令を送り切ってから (最大 flush_timeout_sec) 全インタフェースの送信スレッドを止め，
+// インタフェースごとに統計を表示する．
+void can_tx_stop(double flush_timeout_sec = 0.5);
+
+// frame をインタフェース bus の cls の待ち行列に積む．kSetpoint を指定した場合は，frame の node_id の位置指令を置き換える．
+// 待ち行列があふれて捨てた場合は false．
+// kSafety の指令を積むと，同じノードの未送信の位置指令は捨てる (指令の順序が逆転しないように)．
+bool can_tx_submit(size_t bus, const can_frame& frame, CanTxClass cls);
+
+// frames[i] (node_id = i + 1 宛ての位置指令) のうち，mask の bit i が立っているものを，
+// それぞれのノードがつながっているインタフェースに振り分けてまとめて積む．
+void can_tx_submit_setpoints(const can_frame* frames, uint32_t mask);
+
+// 前回の呼び出しから，書き込めずに捨てた位置指令があったノードのマスク (bit i が node_id = i + 1) を返してクリアする．
+// 送信スレッドが止まっていた，送信エラー，停止時の積み残し，kSafety の指令に取って代わられた場合が含まれる
+// (新しい位置指令で置き換えた場合は含まない)．変化の小さい関節を間引く側が，送り直す関節を知るために使う．
+uint32_t can_tx_take_dropped_setpoints();
@@ -1,25 +1,51 @@
 #include "can_utils.h"
+#include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <unistd.h>
 #include <net/if.h>
 #include <linux/can.h>
 #include <linux/can/raw.h>
 
+#include <array>
 #include <cstring>
+#include <iostream>
 
-static int can_sock = -1;
+#include "can_topology.h"
+#include "can_tx.h"
+
+// index はインタフェースの番号 (can_topology.h)．
+static std::array<int, CAN_MAX_BUSES> can_socks{-1, -1, -1, -1};
 
 constexpr uint16_t CMD_SET_AXIS_REQUESTED_STATE = 0x007;
 constexpr uint32_t AXIS_STATE_IDLE = 1;
-constexpr uint16_t CMD_GET_ENCODER_ESTIMATES = 0x009;
 constexpr uint16_t CMD_SET_INPUT_POS = 0x00C;
 constexpr uint16_t CMD_SET_ABSOLUTE_POSITION = 0x019;
 
-void can_init(const char* ifname) {
-    can_sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+// send_positions() 用に事前に組み立てておくフレーム.
+// pos_frames[i] は node_id = i + 1 宛ての Set_Input_Pos.
+static can_frame pos_frames[CAN_MAX_BATCH_NODES];
+
+static void build_position_templates() {
+    for (size_t i = 0; i < CAN_MAX_BATCH_NODES; ++i) {
+        pos_frames[i] = can_frame{};
+        pos_frames[i].can_id  = ((i + 1) << 5) | CMD_SET_INPUT_POS;
+        pos_frames[i].can_dlc = 4;
+    }
+}
+
+static int open_tx_socket(const char* ifname) {
+    const int can_sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (can_sock < 0) {
+        std::cerr << "[CAN] socket(PF_CAN) failed (" << ifname << ")" << std::endl;
+    }
+
+    // このソケットは送信専用．受信は can_rx が受け持つので，
+    // 空のフィルタを設定してカーネルが受信フレームを積まないようにする．
+    setsockopt(can_sock, SOL_CAN_RAW, CAN_RAW_FILTER, nullptr, 0);
 
     ifreq ifr{};
-    std::strcpy(ifr.ifr_name, ifname);
+    std::strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
     ioctl(can_sock, SIOCGIFINDEX, &ifr);
 
     sockaddr_can addr{};
@@ -27,20 +53,38 @@ void can_init(const char* ifname) {
     addr.can_ifindex = ifr.ifr_ifindex;
 
     [[maybe_unused]] auto _ = bind(can_sock, (sockaddr*)&addr, sizeof(addr));
+
+    // 書き込みは送信スケジューラ (can_tx.h) のスレッドだけが行い，送信バッファが一杯なら poll() で待つ.
+    const int flags = fcntl(can_sock, F_GETFL, 0);
+    fcntl(can_sock, F_SETFL, flags | O_NONBLOCK);
+    return can_sock;
+}
+
+void can_init() {
+    build_position_templates();
+    for (size_t bus = 0; bus < can_bus_count(); ++bus) {
+        can_socks[bus] = open_tx_socket(can_bus_name(bus));
+        can_tx_start(bus, can_socks[bus]);
+    }
 }
 
 void can_close() {
-    if (can_sock >= 0) { 
-        close(can_sock);
+    can_tx_stop();
+    for (int& sock : can_socks) {
+        if (sock >= 0) {
+            close(sock);
+            sock = -1;
+        }
     }
 }
 
+// 状態遷移の指令は最優先で送る.
 void send_axis_state(const int node_id, const uint32_t state) {
     can_frame f{};
     f.can_id  = (node_id << 5) | CMD_SET_AXIS_REQUESTED_STATE;
     f.can_dlc = 4;
     std::memcpy(f.data, &state, 4);
-    write(can_sock, &f, sizeof(f));
+    can_tx_submit(can_bus_of_node(node_id), f, CanTxClass::kSafety);
 }
 
 void send_position(const int node_id, const float pos) {
@@ -48,7 +92,21 @@ void send_position(const int node_id, const float pos) {
     f.can_id  = (node_id << 5) | CMD_SET_INPUT_POS;
     f.can_dlc = 4;
     std::memcpy(f.data, &pos, 4);
-    write(can_sock, &f, sizeof(f));
+    can_tx_submit(can_bus_of_node(node_id), f, CanTxClass::kSetpoint);
+}
+
+void send_positions(const float* angles, const size_t n) {
+    send_positions(angles, n, ~0u);
+}
+
+void send_positions(const float* angles, const size_t n, const uint32_t mask) {
+    const size_t limit = (n < CAN_MAX_BATCH_NODES) ? n : CAN_MAX_BATCH_NODES;
+    const uint32_t selected = mask & ((limit >= 32) ? ~0u : ((1u << limit) - 1));
+    for (uint32_t m = selected; m != 0; m &= m - 1) {
+        const int i = __builtin_ctz(m);
+        std::memcpy(pos_frames[i].data, &angles[i], 4);
+    }
+    can_tx_submit_setpoints(pos_frames, selected);
 }
 
 void send_can_raw(const uint32_t can_id, const uint8_t* data, const  uint8_t dlc) {
@@ -56,29 +114,16 @@ void send_can_raw(const uint32_t can_id, const uint8_t* data, const  uint8_t dlc
     f.can_id  = can_id;
     f.can_dlc = dlc;
     std::memcpy(f.data, data, dlc);
-    write(can_sock, &f, sizeof(f));
+    can_tx_submit(can_pico_bus(), f, CanTxClass::kHousekeeping);
 }
 
+// 絶対位置の設定は位置指令との順序が崩れないよう，状態遷移と同じ扱いにする.
 void send_set_absolute_position(const int node_id, const float pos) {
     can_frame f{};
     f.can_id  = (node_id << 5) | CMD_SET_ABSOLUTE_POSITION;
     f.can_dlc = 4;
     std::memcpy(f.data, &pos, 4);
-    write(can_sock, &f, sizeof(f));
-}
-
-bool get_position_only(int& node_id, float& pos) {
-    can_frame f{};
-    int n = read(can_sock, &f, sizeof(f));
-    if (n <= 0) return false;
-
-    uint16_t cmd = f.can_id & 0x1F;
-    if (cmd != CMD_GET_ENCODER_ESTIMATES) return false;
-
-    node_id = f.can_id >> 5;
-    std::memcpy(&pos, f.data, 4);  // data[0..3] だけ
-
-    return true;
+    can_tx_submit(can_bus_of_node(node_id), f, CanTxClass::kSafety);
 }
 
 void stop_odrive(int node_id) {
@@ -1,16 +1,37 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
-void can_init(const char* ifname);
+// ODrive への送信は送信スケジューラ (can_tx.h) を通す．各関数はフレームを積むだけで，待たずに戻る．
+// 状態遷移・停止・絶対位置の設定は最優先，位置指令はノードごとに最新のものだけを送る．
 
-// CAN 通信を終了する．
+// 一括送信できるノード数の上限．
+constexpr size_t CAN_MAX_BATCH_NODES = 32;
+
+// インタフェース (can_topology.h) ごとに送信用のソケットを開き，送信スケジューラを起動する．
+// ODrive 宛てのフレームは node_id がつながっているインタフェースへ，send_can_raw() は Pico のインタフェースへ送る．
+// 送信したフレームはバス使用率の見積もり (can_bus_load.h) にインタフェースごとに数える．
+// can_set_topology() の後に呼ぶこと．
+void can_init();
+
+// CAN 通信を終了する．積んである停止指令などは送り切ってから閉じる．
 // これを呼んだのち，直ちにプログラムを終了すること．
 void can_close();
 
 void send_axis_state(int node_id, uint32_t state);
 void send_position(int node_id, float pos);
+
+// angles[i] を node_id = i + 1 の ODrive へ Set_Input_Pos として一括送信する．
+// can_init() で組み立て済みのフレームに角度だけを書き込み，まとめて送信スケジューラに積む．
+// まだ送られていない同じノードの位置指令は置き換える．
+// 内部のテンプレートを書き換えるので，複数のスレッドから同時に呼ばないこと．
+// 実際に書き込めなかった位置指令は can_tx_take_dropped_setpoints() (can_tx.h) で分かる．
+void send_positions(const float* angles, size_t n);
+
+// send_positions() と同じだが，mask の bit i が立っている関節 (node_id = i + 1) だけを送る．
+void send_positions(const float* angles, size_t n, uint32_t mask);
+
 void send_can_raw(uint32_t can_id, const uint8_t* data, uint8_t dlc);
 void send_set_absolute_position(int node_id, float pos);
-bool get_position_only(int& node_id, float& pos);
-void stop_odrive(int node_id);
\ No newline at end of file
+void stop_odrive(int node_id);
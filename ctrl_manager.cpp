@@ -4,15 +4,22 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#include <array>
 #include <chrono>
+#include <cmath>
 #include <cstring>
+#include <ctime>
 #include <cerrno>
 #include <iostream>
+#include <string>
 #include <thread>
 
+#include "calibration_store.h"
 #include "can_utils.h"
 #include "global_variable.h"
-#include "constants.h"
+#include "odrive_status.h"
+#include "time_utils.h"
+#include "zero_calibration.h"
 
 
 constexpr int CTRL_PORT = 60000;
@@ -20,136 +27,446 @@ constexpr int CTRL_PORT = 60000;
 constexpr uint32_t AXIS_STATE_FULL_CALIBRATION_SEQUENCE = 3;
 constexpr uint32_t AXIS_STATE_CLOSED_LOOP_CONTROL = 8;
 
-static const int NODE_ID[16] = {
-    1,2,3,4,
-    5,6,7,8,
-    9,10,11,12,
-    13,14,15,16
-};
+constexpr double ODRIVE_CALIB_POLL_SEC = 0.1;          // キャリブレーション中にハートビートを見る周期.
+constexpr double ODRIVE_CALIB_START_TIMEOUT_SEC = 2.0;  // ☆ 指令後にキャリブレーションが始まるまでの上限.
+constexpr double ODRIVE_CALIB_TIMEOUT_SEC = 30.0;       // ☆ 1 ノードのキャリブレーションにかかる時間の上限.
+constexpr double WARM_START_POT_WAIT_SEC = 2.0;          // 起動時にポテンショメータ値が届くのを待つ上限.
+constexpr double WARM_START_CLOSED_LOOP_TIMEOUT_SEC = 2.0;  // 閉ループに入るのを待つ上限.
+constexpr double WARM_START_ENCODER_MAX_AGE_SEC = 0.5;      // 使うエンコーダ推定値の鮮度の上限.
+constexpr float WARM_START_ENCODER_TOLERANCE_ROT = 0.05f;   // ☆ 保存時と同じ座標とみなす位置推定値の差 [rot].
+constexpr double ZERO_CALIB_STEP_SEC = 0.1;           // ゼロ点キャリブレーションの 1 ステップの周期.
+constexpr double ZERO_CALIB_SETTLE_SEC = 1.0;         // 絶対位置を送った後に待つ時間.
+constexpr double IDLE_WAIT_SEC = 0.5;                 // 処理中でないときに状態を見直す間隔.
 
 static std::thread ctrl_thread;
 
-// モータの0点キャリブレーションを行う.
-static void calibrate_zero_position() {
-    std::cout << "[CTRL] Potentiometer zero calibration command received. / ポテンショメータゼロ点キャリブレーションを行います．" << std::endl;
-
-    // 各関節に対して，ポテンショメータ値を送信する.
-    std::array<bool, 16> calibrated{};
-    std::array<double, 16> last_send_pos{0.0};
-
-    // ☆ ここの値の正負を変更すると，キャリブレーション時の回転方向が変わる．
-    const std::array<float, 16> vec_pm{-1.0f, -1.0f, 1.0f,
-                                 -1.0f, -1.0f, -1.0f,
-                                 -1.0f, -1.0f, 1.0f,
-                                 1.0f, 1.0f, -1.0f,
-                                 -1.0f, -1.0f,
-                                 -1.0f, -1.0f};
-
-    // ☆ 関節ごとの許容誤差値（ポテンショメータ値の差分）．
-    const std::array<float, 16> clam_val{
-        50.0f,50.0f,200.0f,
-        50.0f,50.0f,200.0f,
-        50.0f,50.0f,200.0f,
-        50.0f,50.0f,200.0f,
-       100.0f,100.0f,
-       100.0f,100.0f};
-
-    constexpr int kCalibGroupSize = 3;  // 3関節ずつキャリブレーションを行う.
-    constexpr int kCalibEndIndex = 12;  // 12 ~ 15 はキャリブレーション不要（胴体関節）
-    int current_group = 0;
-    int last_logged_group = -1;
-
-    // 初期化：キャリブレーション不要な関節は最初から完了にする.
-    for (int i = 0; i < 16; ++i) {
-        calibrated[i] = (i >= kCalibEndIndex);
-    }
-
-    while(true) {        
-        bool all_done = true;
-        for (const auto v : calibrated) {
-            if (!v) {
-                all_done = false;
-                break;
+// 時間のかかる処理．ctrl_tick() が少しずつ進める．
+enum class Activity {
+    kNone,
+    kOdriveCalibration,    // ODrive のキャリブレーション完了待ち.
+    kZeroCalibration,      // ポテンショメータによるゼロ点合わせ.
+    kZeroSettle,           // 絶対位置を送った後の待ち.
+    kWarmStartPots,        // 起動時: ポテンショメータ値を保存したゼロ点と比べる.
+    kWarmStartClosedLoop,  // 起動時: 閉ループに入るのを待つ.
+};
+
+static Activity activity = Activity::kNone;
+static double activity_deadline = 0.0;  // 次に activity を進める時刻 (now_time_sec() 基準).
+
+// キャリブレーション結果の保存先 (ctrl_set_calibration_file() で変更する)．空なら保存しない.
+static std::string calib_file_path = "calibration.bin";
+static bool warm_start_pending = true;  // 最初の ctrl_tick() で保存した結果からの起動を試す.
+static bool settle_after_warm_start = false;
+static bool warm_start_armed = false;  // 保存した結果と一致したので，cmd=2 で閉ループに入れる.
+static CalibrationRecord warm_start_record;
+static double warm_start_deadline = 0.0;
+static double warm_start_sent = 0.0;
+
+// ODrive キャリブレーション中のノードごとの進み具合．index は node_id - 1．
+enum class NodeCalib {
+    kWaiting,  // まだ IDLE 以外の状態を報告していない.
+    kBusy,     // キャリブレーション中.
+    kDone,     // エラーなしで IDLE に戻った.
+    kFailed,
+};
+
+struct NodeCalibStatus {
+    NodeCalib phase = NodeCalib::kWaiting;
+    double started = 0.0;  // 指令を送った時刻.
+    OdriveHeartbeat last{};
+    bool has_heartbeat = false;
+    const char* reason = "";
+};
+
+static std::array<NodeCalibStatus, NUM_ODRIVE> node_calib;
+static double odrive_calib_started = 0.0;
+
+// 最後に処理したときの "cmd" と "system_state" の版数.
+static uint64_t seen_cmd = 0;
+static uint64_t seen_state = 0;
+
+// ゼロ点合わせで同時に動かす脚 (ctrl_set_zero_calib_policy() で変更する)．
+static ZeroCalibPolicy zero_calib_policy = ZeroCalibPolicy::kPerLeg;
+
+// ===== ODrive キャリブレーション =====
+
+// ハートビートを見て各ノードの進み具合を更新する．全ノードの結果が出たら true を返す.
+// 直後のハートビートは指令前の IDLE を報告していることがあるので，一度 IDLE 以外を見てから
+// IDLE に戻ったものを完了とみなす.
+static bool update_odrive_calibration(const double now) {
+    bool finished = true;
+    for (int i = 0; i < NUM_ODRIVE; ++i) {
+        NodeCalibStatus& node = node_calib[i];
+        if (node.phase == NodeCalib::kDone || node.phase == NodeCalib::kFailed) {
+            continue;
+        }
+
+        OdriveHeartbeat hb{};
+        if (odrive_heartbeat_since(i + 1, node.started, hb)) {
+            node.last = hb;
+            node.has_heartbeat = true;
+
+            if (hb.axis_error != 0) {
+                node.phase = NodeCalib::kFailed;
+                node.reason = "axis error";
+            } else if (hb.axis_state != ODRIVE_AXIS_STATE_IDLE) {
+                node.phase = NodeCalib::kBusy;
+            } else if (node.phase == NodeCalib::kBusy) {
+                node.phase = (hb.procedure_result == 0) ? NodeCalib::kDone : NodeCalib::kFailed;
+                node.reason = "procedure result";
             }
         }
 
-        if (all_done) {
-            break;
+        const double elapsed = now - node.started;
+        if (node.phase == NodeCalib::kWaiting && elapsed > ODRIVE_CALIB_START_TIMEOUT_SEC) {
+            node.phase = NodeCalib::kFailed;
+            node.reason = node.has_heartbeat ? "not started" : "no heartbeat";
+        } else if (node.phase == NodeCalib::kBusy && elapsed > ODRIVE_CALIB_TIMEOUT_SEC) {
+            node.phase = NodeCalib::kFailed;
+            node.reason = "timeout";
         }
 
-        const auto pot_values = g_pot_values.Back();
+        if (node.phase == NodeCalib::kWaiting || node.phase == NodeCalib::kBusy) {
+            finished = false;
+        }
+    }
+    return finished;
+}
 
-        const int group_start = current_group * kCalibGroupSize;
-        const int group_end = group_start + kCalibGroupSize;
-        if (current_group != last_logged_group && group_start < kCalibEndIndex) {
-            std::cout << "[CTRL] Calib group " << current_group
-                      << " (" << group_start << ".." << (group_end - 1) << ")"
-                      << " start" << std::endl;
-            last_logged_group = current_group;
+static void report_odrive_calibration_failures() {
+    for (int i = 0; i < NUM_ODRIVE; ++i) {
+        const NodeCalibStatus& node = node_calib[i];
+        if (node.phase != NodeCalib::kFailed) {
+            continue;
+        }
+        std::cerr << "[CTRL]   node " << (i + 1) << ": " << node.reason;
+        if (node.has_heartbeat) {
+            std::cerr << " (state=" << static_cast<int>(node.last.axis_state)
+                      << " axis_error=0x" << std::hex << node.last.axis_error << std::dec
+                      << " result=" << static_cast<int>(node.last.procedure_result) << ")";
         }
+        std::cerr << std::endl;
+    }
+}
 
-        for (int i = 0; i < 16; ++i) {
-            // 基本的にプログラム上ではモータの index は 0 始まりなので注意．
-            // CAN に送る段階で +1 する．
-            if (calibrated[i]) {
-                continue;
-            }
-            if (i < kCalibEndIndex && (i < group_start || i >= group_end)) {
-                continue;
-            }
+// ===== 保存したキャリブレーション結果からの起動 =====
+
+// 保存したファイルがあれば，起動時のゼロ点合わせの省略を試みる.
+static void begin_warm_start(const double now) {
+    if (calib_file_path.empty() || g_thread_safe_store.Get(KEY_SYSTEM_STATE) != SystemState::INIT) {
+        return;
+    }
+    if (!calibration_load(calib_file_path.c_str(), warm_start_record)) {
+        return;
+    }
+    const double age_hours = static_cast<double>(std::time(nullptr) - warm_start_record.saved_unix_sec) / 3600.0;
+    std::cout << "[CTRL] Found saved calibration (" << age_hours << " h old), checking potentiometers."
+                 " / 保存したキャリブレーション結果を確認します．" << std::endl;
+
+    activity = Activity::kWarmStartPots;
+    activity_deadline = now;
+    warm_start_deadline = now + WARM_START_POT_WAIT_SEC;
+}
+
+// 保存時にゼロ点での位置推定値 (encoder_offset) を記録した関節は，それを使って絶対位置を合わせる．
+//   今の推定値が encoder_offset に近い : ODrive の座標が保存時と同じ (絶対エンコーダなど)．今の位置は p - encoder_offset．
+//   今の推定値が 0 に近い             : 前回ゼロ点に合わせた座標が残っている．そのままにする.
+//   それ以外・記録なし               : ポテンショメータで確かめたゼロ点付近なので，ここを 0 とする.
+static void set_warm_start_positions() {
+    const double now = now_time_sec();
+    int from_offset = 0;
+    int kept = 0;
+    int zeroed = 0;
+    for (int id = 1; id <= NUM_ODRIVE; ++id) {
+        const JointCalibration& joint = warm_start_record.joints[id - 1];
+        const auto estimate = g_encoder_estimates[id - 1].Latest();
+        const bool usable = (joint.flags & CALIB_FLAG_ENCODER) && estimate
+                            && now - estimate->time <= WARM_START_ENCODER_MAX_AGE_SEC;
+        const float pos = usable ? estimate->value.pos : 0.0f;
+        if (usable && std::fabs(pos - joint.encoder_offset) <= WARM_START_ENCODER_TOLERANCE_ROT) {
+            send_set_absolute_position(id, pos - joint.encoder_offset);
+            ++from_offset;
+        } else if (usable && std::fabs(pos) <= WARM_START_ENCODER_TOLERANCE_ROT) {
+            ++kept;
+        } else {
+            send_set_absolute_position(id, 0.0f);
+            ++zeroed;
+        }
+    }
+    std::cout << "[CTRL] Warm start positions: from saved encoder offset=" << from_offset
+              << " kept=" << kept << " zeroed here=" << zeroed << std::endl;
+}
 
-            const int now = pot_values[i / 3][i % 3];
-            const float now_rot = static_cast<float>(now) / 4095.0f + 1.5f;
-            const int target = POT_DEFAULT_ANGLES[i];
-            const float target_rot = static_cast<float>(target) / 4095.0f + 1.5f;
-
-            std::cout << "[CTRL] Joint " << i
-                    << ": pot=" << now << " (" << now_rot << " rot), "
-                    << "target=" << target << " (" << target_rot << " rot)"
-                    << std::endl;
-            
-            // ポテンショメータ値を目標値に合わせるように ODrive に送信する.
-            const float rot_diff = 0.1f;  // 一回に送る回転量の差分(回転速度)
-            if (std::abs(target - now) > clam_val[i]) {
-                last_send_pos[i] += ((now < target) ? rot_diff : -rot_diff) * vec_pm[i];
-                const float send_pos = last_send_pos[i];
-                send_position(i + 1, send_pos);
+// 閉ループに入れなかったノードを表示する．全ノード入っていれば true．
+static bool all_in_closed_loop(const bool report) {
+    bool ok = true;
+    for (int id = 1; id <= NUM_ODRIVE; ++id) {
+        OdriveHeartbeat hb{};
+        const bool has_heartbeat = odrive_heartbeat_since(id, warm_start_sent, hb);
+        if (has_heartbeat && hb.axis_error == 0 && hb.axis_state == AXIS_STATE_CLOSED_LOOP_CONTROL) {
+            continue;
+        }
+        ok = false;
+        if (report) {
+            std::cerr << "[CTRL]   node " << id;
+            if (has_heartbeat) {
+                std::cerr << ": state=" << static_cast<int>(hb.axis_state)
+                          << " axis_error=0x" << std::hex << hb.axis_error << std::dec << std::endl;
             } else {
-                calibrated[i] = true;
+                std::cerr << ": no heartbeat" << std::endl;
             }
+        }
+    }
+    return ok;
+}
+
+// ===== 状態遷移 =====
 
+// 実行中の activity を，期限が来ていれば進める.
+static void run_activity(const double now) {
+    if (now < activity_deadline) {
+        return;
+    }
+
+    switch (activity) {
+    case Activity::kOdriveCalibration: {
+        if (!update_odrive_calibration(now)) {
+            activity_deadline = now + ODRIVE_CALIB_POLL_SEC;
+            break;
         }
+        activity = Activity::kNone;
 
-        bool group_done = true;
-        for (int i = group_start; i < group_end && i < kCalibEndIndex; ++i) {
-            if (!calibrated[i]) {
-                group_done = false;
-                break;
+        bool ok = true;
+        for (const auto& node : node_calib) {
+            ok = ok && (node.phase == NodeCalib::kDone);
+        }
+        if (!ok) {
+            // 状態は INIT のままなので，原因を取り除いてから cmd=1 でやり直せる.
+            std::cerr << "[CTRL] ODrive calibration failed. / キャリブレーションに失敗しました." << std::endl;
+            report_odrive_calibration_failures();
+            break;
+        }
+        g_thread_safe_store.Set(KEY_SYSTEM_STATE, SystemState::CALIBRATED);
+        std::cout << "[CTRL] Calibration done in " << (now - odrive_calib_started)
+                  << " s. / キャリブレーションが完了しました." << std::endl;
+        break;
+    }
+
+    case Activity::kZeroCalibration: {
+        const ZeroCalibStep step = zero_calib_step(now);
+        if (step == ZeroCalibStep::kFailed) {
+            // 状態は CALIBRATED のままなので，原因を取り除いてから cmd=3 でやり直せる.
+            activity = Activity::kNone;
+            std::cerr << "[CTRL] Zero calibration aborted. / ゼロ点キャリブレーションを中止しました．" << std::endl;
+            break;
+        }
+        if (step == ZeroCalibStep::kContinue) {
+            activity_deadline += ZERO_CALIB_STEP_SEC;
+            if (activity_deadline < now) {
+                activity_deadline = now + ZERO_CALIB_STEP_SEC;
             }
+            break;
+        }
+
+        // 次回の起動で使えるよう，絶対位置を 0 にする前の値を保存する.
+        if (!calib_file_path.empty()) {
+            CalibrationRecord record;
+            zero_calib_capture(record);
+            calibration_save(calib_file_path.c_str(), record);
         }
-        if (group_done && group_start < kCalibEndIndex) {
-            std::cout << "[CTRL] Calib group " << current_group
-                      << " (" << group_start << ".." << (group_end - 1) << ")"
-                      << " done" << std::endl;
-            ++current_group;
+
+        // ODriveに絶対位置として送信する.
+        for (int id = 1; id <= NUM_ODRIVE; ++id) {
+            send_set_absolute_position(id, 0.0f);
         }
-        
-        std::cout << std::endl << std::endl;
 
         // 少し待つ.
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        settle_after_warm_start = false;
+        activity = Activity::kZeroSettle;
+        activity_deadline = now + ZERO_CALIB_SETTLE_SEC;
+        break;
     }
-    
-    // ODriveに絶対位置として送信する.
-    for (int i = 0; i < 16; ++i) {
-        send_set_absolute_position(i + 1, 0.0f);
+
+    case Activity::kZeroSettle:
+        activity = Activity::kNone;
+        if (settle_after_warm_start) {
+            std::cout << "[CTRL] Started from saved calibration. /"
+                " 保存したキャリブレーション結果で起動しました." << std::endl;
+        } else {
+            std::cout << "[CTRL] Potentiometer zero calibration done. /"
+                " ポテンショメータゼロ点キャリブレーションを完了しました." << std::endl;
+        }
+
+        // READY状態にする．
+        g_thread_safe_store.Set(KEY_SYSTEM_STATE, SystemState::READY);
+        break;
+
+    case Activity::kWarmStartPots:
+        if (!zero_calib_pots_fresh()) {
+            if (now < warm_start_deadline) {
+                activity_deadline = now + ODRIVE_CALIB_POLL_SEC;
+                break;
+            }
+            activity = Activity::kNone;
+            std::cerr << "[CTRL] No potentiometer values, skipping warm start. /"
+                " ポテンショメータ値が届かないので，通常の手順 (cmd=1) で起動してください．" << std::endl;
+            break;
+        }
+        activity = Activity::kNone;
+        if (!zero_calib_matches(warm_start_record)) {
+            std::cout << "[CTRL] Joints moved since the saved calibration. /"
+                " 保存時から関節が動いているので，通常の手順 (cmd=1) で起動してください．" << std::endl;
+            break;
+        }
+
+        // モータに勝手に力を入れないよう，閉ループに入れるのは操作者の cmd=2 を待つ.
+        warm_start_armed = true;
+        std::cout << "[CTRL] Saved calibration matches. Send cmd=2 to enter closed loop from it. /"
+            " 保存したキャリブレーション結果と一致しました．cmd=2 で閉ループに入り READY まで進みます．" << std::endl;
+        break;
+
+    case Activity::kWarmStartClosedLoop:
+        if (!all_in_closed_loop(false)) {
+            if (now < warm_start_deadline) {
+                activity_deadline = now + ODRIVE_CALIB_POLL_SEC;
+                break;
+            }
+            activity = Activity::kNone;
+            std::cerr << "[CTRL] ODrives did not enter closed loop, skipping warm start. /"
+                " 閉ループに入れないので，通常の手順 (cmd=1) で起動してください．" << std::endl;
+            all_in_closed_loop(true);
+            for (int id = 1; id <= NUM_ODRIVE; ++id) {
+                stop_odrive(id);
+            }
+            break;
+        }
+
+        // ゼロ点付近にいることはポテンショメータで確かめてある.
+        set_warm_start_positions();
+        settle_after_warm_start = true;
+        activity = Activity::kZeroSettle;
+        activity_deadline = now + ZERO_CALIB_SETTLE_SEC;
+        break;
+
+    case Activity::kNone:
+        break;
     }
+}
 
-    // 少し待つ.
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+// 保存した結果から閉ループに入れる (cmd=2，INIT のとき)．ポテンショメータ値はもう一度確かめる.
+static void enter_warm_start(const double now) {
+    warm_start_armed = false;
+    if (!zero_calib_pots_fresh() || !zero_calib_matches(warm_start_record)) {
+        std::cout << "[CTRL] Joints moved since the saved calibration. /"
+            " 保存時から関節が動いているので，通常の手順 (cmd=1) で起動してください．" << std::endl;
+        return;
+    }
 
-    std::cout << "[CTRL] Potentiometer zero calibration done. /"
-        " ポテンショメータゼロ点キャリブレーションを完了しました." << std::endl;
+    // ODrive 自身のキャリブレーションが残っていれば (電源を切っていない，または
+    // pre_calibrated を保存している)，そのまま閉ループに入れる.
+    warm_start_sent = now_time_sec();
+    for (int id = 1; id <= NUM_ODRIVE; ++id) {
+        send_axis_state(id, AXIS_STATE_CLOSED_LOOP_CONTROL);
+    }
+    activity = Activity::kWarmStartClosedLoop;
+    activity_deadline = now + ODRIVE_CALIB_POLL_SEC;
+    warm_start_deadline = now + WARM_START_CLOSED_LOOP_TIMEOUT_SEC;
+}
+
+static void handle_command(const int8_t cmd, const SystemState state, const double now) {
+    if (cmd == 1 || cmd == 8) {
+        warm_start_armed = false;
+    }
+
+    if (cmd == 2 && state == SystemState::INIT && warm_start_armed && activity == Activity::kNone) {
+        enter_warm_start(now);
+    } else if (cmd == 1 && state == SystemState::INIT) {
+        std::cout << "[CTRL] Start calibration command received. / キャリブレーション開始コマンドを受信しました." << std::endl;
+        odrive_calib_started = now;
+        for (int id = 1; id <= NUM_ODRIVE; ++id) {
+            send_axis_state(id, AXIS_STATE_FULL_CALIBRATION_SEQUENCE);
+            node_calib[id - 1] = NodeCalibStatus{};
+            node_calib[id - 1].started = now_time_sec();
+
+            // ☆ 丹下さんのやつは同時にキャリブレーション始めると不安定になったので，無理だったら待ってみて．
+            // std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+
+        // 完了はハートビートで判定する (ブロックしない).
+        activity = Activity::kOdriveCalibration;
+        activity_deadline = now + ODRIVE_CALIB_POLL_SEC;
+    } else if (cmd == 2 && state == SystemState::CALIBRATED) {
+        // 閉ループ開始にする．
+        for (int id = 1; id <= NUM_ODRIVE; ++id) {
+            send_axis_state(id, AXIS_STATE_CLOSED_LOOP_CONTROL);
+        }
+    } else if (cmd == 3 && state == SystemState::CALIBRATED) {
+        // ここでポテンショメータ値をゼロ点キャリブレーションする．
+        zero_calib_begin(zero_calib_policy, now);
+        activity = Activity::kZeroCalibration;
+        activity_deadline = now;
+    } else if (cmd == 6 && state == SystemState::READY) {
+        g_thread_safe_store.Set(KEY_SYSTEM_STATE, SystemState::RUN);
+    } else if (cmd == 7 && state == SystemState::RUN) {
+        g_thread_safe_store.Set(KEY_SYSTEM_STATE, SystemState::READY);
+    } else if (cmd == 8) {
+        for (int id = 1; id <= NUM_ODRIVE; ++id) {
+            stop_odrive(id);
+        }
+        // 同じ状態を書き直すと版数が進んで再処理されるので，変わるときだけ書く.
+        if (state != SystemState::INIT) {
+            g_thread_safe_store.Set(KEY_SYSTEM_STATE, SystemState::INIT);
+        }
+    }
+}
+
+void ctrl_tick() {
+    const double now = now_time_sec();
+    const uint64_t cmd_version = g_thread_safe_store.Version(KEY_CMD);
+    const uint64_t state_version = g_thread_safe_store.Version(KEY_SYSTEM_STATE);
+
+    if (warm_start_pending) {
+        warm_start_pending = false;
+        begin_warm_start(now);
+    }
+
+    if (activity != Activity::kNone) {
+        // 実行中の処理は，新たに書かれた cmd=8 でだけ中断する.
+        if (cmd_version != seen_cmd && g_thread_safe_store.Get(KEY_CMD) == 8) {
+            std::cout << "[CTRL] Aborted by cmd=8. / cmd=8 により中断しました." << std::endl;
+            activity = Activity::kNone;
+        } else {
+            run_activity(now);
+            return;
+        }
+    }
+
+    if (cmd_version == seen_cmd && state_version == seen_state) {
+        return;
+    }
+    seen_cmd = cmd_version;
+    seen_state = state_version;
+
+    const int8_t cmd = static_cast<int8_t>(g_thread_safe_store.Get(KEY_CMD));
+    const SystemState state = g_thread_safe_store.Get(KEY_SYSTEM_STATE);
+    handle_command(cmd, state, now);
+}
+
+void ctrl_set_zero_calib_policy(const ZeroCalibPolicy policy) {
+    zero_calib_policy = policy;
+}
+
+void ctrl_set_calibration_file(const char* path, const bool warm_start) {
+    calib_file_path = (path != nullptr) ? path : "";
+    warm_start_pending = warm_start;
+}
+
+double ctrl_next_tick_sec() {
+    if (activity == Activity::kNone) {
+        return IDLE_WAIT_SEC;
+    }
+    const double wait = activity_deadline - now_time_sec();
+    return (wait > 0.0) ? wait : 0.0;
 }
 
 static void ctrl_loop() {
@@ -176,67 +493,22 @@ static void ctrl_loop() {
         return;
     }
 
-    uint8_t buf[8];
-
     std::cout << "[CTRL] listening CTRL on " << CTRL_PORT << std::endl;
 
-    while (!g_thread_safe_store.Get<bool>("fin")) {
-        // const ssize_t len = recvfrom(sock, buf, sizeof(buf), 0, nullptr, nullptr);
-        // if (len < 0) {
-        //     if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-        //         std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        //         continue;
-        //     }
-        //     std::cerr << "[CTRL] recvfrom() failed" << std::endl;
-        //     break;
-        // }
-        // if (len < 6) { continue; }
-        // if (std::memcmp(buf, "CTRL", 4) != 0) { continue; }
-
-        // const uint8_t cmd = buf[4];
-        const int8_t cmd = static_cast<int8_t>(g_thread_safe_store.Get<int>("cmd"));
-
-        const SystemState state = g_thread_safe_store.Get<SystemState>("system_state");
-        if (cmd == 1 && state == SystemState::INIT) {
-            std::cout << "[CTRL] Start calibration command received. / キャリブレーション開始コマンドを受信しました." << std::endl;
-            for (const auto& id : NODE_ID) {
-                send_axis_state(id, AXIS_STATE_FULL_CALIBRATION_SEQUENCE);
-
-                // ☆ 丹下さんのやつは同時にキャリブレーション始めると不安定になったので，無理だったら待ってみて．
-                // std::this_thread::sleep_for(std::chrono::seconds(1));
-            }
-            
-            std::this_thread::sleep_for(std::chrono::seconds(15));
-            g_thread_safe_store.Set<SystemState>("system_state", SystemState::CALIBRATED);
-            std::cout << "[CTRL] Calibration sequence sent. / キャリブレーションシーケンスを送信しました." << std::endl;
-        } else if (cmd == 2 && state == SystemState::CALIBRATED) {
-            // 閉ループ開始にする．
-            for (const auto& id : NODE_ID) {
-                send_axis_state(id, AXIS_STATE_CLOSED_LOOP_CONTROL);
-            }
-        } else if (cmd == 3 && state == SystemState::CALIBRATED) {
-            // ここでポテンショメータ値をゼロ点キャリブレーションする．
-            calibrate_zero_position();
-
-            // READY状態にする．
-            g_thread_safe_store.Set<SystemState>("system_state", SystemState::READY);
-        } else if (cmd == 6 && state == SystemState::READY) {
-            g_thread_safe_store.Set<SystemState>("system_state", SystemState::RUN);
-        } else if (cmd == 7 && state == SystemState::RUN) {
-            g_thread_safe_store.Set<SystemState>("system_state", SystemState::READY);
-        } else if (cmd == 8) {
-            for (const auto& id : NODE_ID) {
-                stop_odrive(id);
-            }
-            g_thread_safe_store.Set<SystemState>("system_state", SystemState::INIT);
-        }
+    while (!g_thread_safe_store.Get(KEY_FIN)) {
+        const uint64_t version = g_thread_safe_store.Version();
+        ctrl_tick();
+
+        // コマンドか状態が書き換わるか，処理中の activity の期限まで眠る．fin の書き込みでも起きる.
+        g_thread_safe_store.WaitForAnyChange(
+            version, std::chrono::duration<double>(ctrl_next_tick_sec()));
     }
     close(sock);
 }
 
 void start_ctrl_thread() {
     std::cout << "[CTRL] Start. / コントロールコマンド受信開始." << std::endl;
-    
+
     ctrl_thread = std::thread(ctrl_loop);
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "system_state.h"
+#include "zero_calibration.h"
 
 // CTRL UDPコマンドを受信して、システム状態を遷移させる．
 // 受信コマンドに応じて、ODriveへキャリブレーション/クローズドループ指令を送る．
@@ -10,7 +11,26 @@
 // key "system_state" に SystemState が保存されているので，それを参照/更新する形にする．
 // また，key "cmd" に最新のコマンドが int 型で保存されているので，それに応じて動作する．
 
+// ゼロ点合わせ (cmd=3) で同時に動かす脚の組み合わせを決める．既定は 1 脚ずつ．
+// スレッドの起動前に呼ぶこと．
+void ctrl_set_zero_calib_policy(ZeroCalibPolicy policy);
+
+// ゼロ点合わせの結果を保存するファイル (calibration_store.h)．既定は "calibration.bin"．
+// 空文字列なら保存しない．warm_start が true なら，起動時にこのファイルを読み，現在のポテンショメータ値が
+// 保存したゼロ点と一致すれば，INIT のまま cmd=2 でキャリブレーションを省いて閉ループ・READY に進めるようにする．
+// 閉ループに入れるのは cmd=2 を受けてからで，起動しただけではモータに力は入らない．
+// スレッドの起動前に呼ぶこと．
+void ctrl_set_calibration_file(const char* path, bool warm_start);
+
 // CTRL受信用スレッドを起動/停止する．
 void start_ctrl_thread();
 void stop_ctrl_thread();
 
+// ===== リアクタモード用 (reactor.h) =====
+// 状態遷移とキャリブレーションは ctrl_tick() で少しずつ進め，呼び出し側を止めない．
+
+// cmd / system_state の変化を処理し，実行中のキャリブレーションを進める．
+void ctrl_tick();
+
+// 次に ctrl_tick() を呼ぶべきまでの秒数．
+double ctrl_next_tick_sec();
@@ -1,130 +1,77 @@
 #include "encoder_logger.h"
 
+#include <fcntl.h>
 #include <sys/stat.h>
-#include <sys/ioctl.h>
-#include <sys/socket.h>
 #include <unistd.h>
-#include <fcntl.h>
 #include <linux/can.h>
-#include <linux/can/raw.h>
-#include <net/if.h>
 
 #include <array>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <cstdio>
 #include <cstring>
-#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "can_rx.h"
 #include "global_variable.h"
+#include "spsc_queue.h"
 #include "system_state.h"
-#include "time_utils.h"
 
 namespace {
 constexpr const char* kLogDir = "logs";
 constexpr uint16_t kCmdGetEncoderEstimates = 0x009;
 
+constexpr size_t kQueueCapacity = 8192;  // 全ノード 100 Hz でも数秒分.
+constexpr auto kFlushInterval = std::chrono::milliseconds(200);  // ファイルへ書き出す周期.
+constexpr size_t kBlockSize = 64 * 1024;  // 1 回の write() の上限.
+constexpr size_t kMaxLineSize = 96;       // CSV 1 行の最大長 (余裕を見た値).
+
 struct EncoderSample {
-    double time;
+    double time;  // カーネル受信時刻 (now_time_sec() 基準).
     uint8_t node_id;
     float pos;
     float vel;
 };
 
-static std::thread encoder_thread;
-static std::vector<EncoderSample> samples;
+// 受信スレッドから書き込みスレッドへ渡すキュー．あふれた分は捨てて数える.
+// 受信スレッドはインタフェースごとにあるので，積む側は sample_push_mutex で 1 本ずつにする.
+static SpscQueue<EncoderSample, kQueueCapacity> sample_queue;
+static std::mutex sample_push_mutex;
+static std::atomic<uint64_t> dropped_samples{0};
 
-int open_can_socket(const char* ifname) {
-    int s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
-    if (s < 0) {
-        std::cerr << "[ENC] socket(PF_CAN) failed" << std::endl;
-        return -1;
-    }
+static std::thread writer_thread;
+static std::atomic<bool> running{false};
 
-    ifreq ifr{};
-    std::strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
-    if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
-        std::cerr << "[ENC] ioctl(SIOCGIFINDEX) failed" << std::endl;
-        close(s);
-        return -1;
+// CAN 受信スレッド (can_rx) 上で呼ばれる．
+void on_encoder_frame(const can_frame& frame, const double rx_time) {
+    if (frame.can_dlc != 8) {
+        return;
     }
 
-    sockaddr_can addr{};
-    addr.can_family = AF_CAN;
-    addr.can_ifindex = ifr.ifr_ifindex;
-
-    if (bind(s, (sockaddr*)&addr, sizeof(addr)) < 0) {
-        std::cerr << "[ENC] bind(CAN) failed" << std::endl;
-        close(s);
-        return -1;
-    }
+    const uint8_t node_id = static_cast<uint8_t>((frame.can_id >> 5) & 0x3F);
+    float pos = 0.0f;
+    float vel = 0.0f;
+    std::memcpy(&pos, &frame.data[0], 4);
+    std::memcpy(&vel, &frame.data[4], 4);
 
-    int flags = fcntl(s, F_GETFL, 0);
-    if (flags < 0 || fcntl(s, F_SETFL, flags | O_NONBLOCK) < 0) {
-        std::cerr << "[ENC] fcntl(O_NONBLOCK) failed" << std::endl;
-        close(s);
-        return -1;
+    // 最新値は状態によらず更新する (テレメトリ送信などが使う).
+    if (node_id >= 1 && node_id <= NUM_ODRIVE) {
+        g_encoder_estimates[node_id - 1].Push(rx_time, {pos, vel});
     }
 
-    return s;
-}
-
-void encoder_loop() {
-    const int sock = open_can_socket("can0");
-    if (sock < 0) {
+    if (g_thread_safe_store.Get(KEY_SYSTEM_STATE) != SystemState::RUN) {
         return;
     }
 
-    samples.clear();
-    samples.reserve(10000);
-
-    while (!g_thread_safe_store.Get<bool>("fin")) {
-        if (g_thread_safe_store.Get<SystemState>("system_state") != SystemState::RUN) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            continue;
-        }
-
-        can_frame frame{};
-        bool received_any = false;
-
-        for (;;) {
-            ssize_t n = read(sock, &frame, sizeof(frame));
-            if (n < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    break;
-                }
-                std::cerr << "[ENC] read(CAN) failed" << std::endl;
-                close(sock);
-                return;
-            }
-            if (n == 0) {
-                break;
-            }
-
-            received_any = true;
-            const uint16_t cmd = frame.can_id & 0x1F;
-            if (cmd != kCmdGetEncoderEstimates || frame.can_dlc != 8) {
-                continue;
-            }
-
-            const uint8_t node_id = static_cast<uint8_t>((frame.can_id >> 5) & 0x3F);
-            float pos = 0.0f;
-            float vel = 0.0f;
-            std::memcpy(&pos, &frame.data[0], 4);
-            std::memcpy(&vel, &frame.data[4], 4);
-
-            const double time = now_time_sec();
-            samples.push_back({time, node_id, pos, vel});
-        }
-
-        if (!received_any) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(2));
-        }
+    std::lock_guard<std::mutex> lock(sample_push_mutex);
+    if (!sample_queue.TryPush({rx_time, node_id, pos, vel})) {
+        dropped_samples.fetch_add(1, std::memory_order_relaxed);
     }
-
-    close(sock);
 }
 
 std::string make_log_path() {
@@ -140,40 +87,110 @@ std::string make_log_path() {
     return std::string(kLogDir) + "/encoder_" + ts_buf.data() + ".csv";
 }
 
-void write_log() {
-    if (samples.empty()) {
-        std::cout << "[ENC] no samples to write" << std::endl;
-        return;
+bool write_all(const int fd, const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
     }
+    return true;
+}
 
-    const std::string path = make_log_path();
-    std::ofstream ofs(path);
-    if (!ofs.is_open()) {
-        std::cerr << "[ENC] file open failed" << std::endl;
-        return;
+// キューにたまったサンプルを定期的に CSV へ追記する．
+// 1 回の書き出しは行単位で区切ったブロックを write() 1 回で書き，fdatasync() で確定させる．
+// そのため異常終了や電源断でも，ファイルは最後に確定したブロックまでは正しく読める．
+void writer_loop() {
+    int fd = -1;
+    std::string path;
+    uint64_t written = 0;
+
+    std::vector<char> block(kBlockSize);
+    size_t used = 0;
+
+    auto flush_block = [&]() {
+        if (used == 0) {
+            return;
+        }
+        if (fd >= 0) {
+            if (!write_all(fd, block.data(), used)) {
+                std::cerr << "[ENC] write failed" << std::endl;
+            }
+            fdatasync(fd);
+        }
+        used = 0;
+    };
+
+    for (;;) {
+        // 停止要求を先に読んでおき，それ以前に積まれた分を書き切ってから抜ける.
+        const bool stopping = !running;
+
+        sample_queue.PopAll([&](const EncoderSample& s) {
+            // 最初のサンプルが来たときにファイルを作る (RUN しなかった回は作らない).
+            if (fd < 0 && path.empty()) {
+                path = make_log_path();
+                fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (fd < 0) {
+                    std::cerr << "[ENC] file open failed" << std::endl;
+                }
+                constexpr char kHeader[] = "time,node_id,pos,vel\n";
+                std::memcpy(block.data(), kHeader, sizeof(kHeader) - 1);
+                used = sizeof(kHeader) - 1;
+            }
+
+            if (block.size() - used < kMaxLineSize) {
+                flush_block();
+            }
+            const int n = std::snprintf(block.data() + used, block.size() - used, "%g,%d,%g,%g\n",
+                                        s.time, static_cast<int>(s.node_id), s.pos, s.vel);
+            if (n > 0) {
+                used += static_cast<size_t>(n);
+            }
+            ++written;
+        });
+        flush_block();
+
+        if (stopping) {
+            break;
+        }
+        std::this_thread::sleep_for(kFlushInterval);
     }
 
-    ofs << "time,node_id,pos,vel\n";
-    for (const auto& s : samples) {
-        ofs << s.time << ','
-            << static_cast<int>(s.node_id) << ','
-            << s.pos << ','
-            << s.vel << '\n';
+    if (fd >= 0) {
+        close(fd);
     }
 
-    std::cout << "[ENC] wrote " << samples.size() << " samples to " << path << std::endl;
+    if (written == 0) {
+        std::cout << "[ENC] no samples to write" << std::endl;
+    } else {
+        std::cout << "[ENC] wrote " << written << " samples to " << path << std::endl;
+    }
+    if (dropped_samples > 0) {
+        std::cout << "[ENC] dropped " << dropped_samples << " samples (queue full)" << std::endl;
+    }
 }
 }  // namespace
 
 void start_encoder_logger_thread() {
     std::cout << "[ENC] start / encoder logging start." << std::endl;
-    encoder_thread = std::thread(encoder_loop);
+
+    // Get_Encoder_Estimates (cmd 0x009) を全インタフェースの全ノード分受け取る.
+    can_rx_register(kCmdGetEncoderEstimates, 0x1F, on_encoder_frame);
+
+    running = true;
+    writer_thread = std::thread(writer_loop);
 }
 
 void stop_encoder_logger_thread() {
-    if (encoder_thread.joinable()) {
-        encoder_thread.join();
+    // can_rx_stop() の後に呼ぶこと．残りを書き出してから終了する.
+    running = false;
+    if (writer_thread.joinable()) {
+        writer_thread.join();
     }
-    write_log();
     std::cout << "[ENC] stopped / encoder logging stopped." << std::endl;
 }
@@ -1,4 +1,9 @@
 #pragma once
 
+// ODrive のエンコーダ推定値 (cmd 0x009) を RUN 中だけ記録し，logs/encoder_*.csv へ逐次書き出す．
+// 受信した最新値は状態によらず g_encoder_estimates (global_variable.h) にも反映する．
+// 受信は can_rx に登録したハンドラで行い，書き込みスレッドが一定周期でファイルへ追記する．
+// start は can_rx_start() より前に，stop は can_rx_stop() より後に呼ぶこと．
+
 void start_encoder_logger_thread();
 void stop_encoder_logger_thread();
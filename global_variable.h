@@ -7,12 +7,74 @@
 #include <array>
 #include <cstdint>
 
+#include "robot_topology.h"
+#include "system_state.h"
+#include "thread_safe_ring.h"
 #include "thread_safe_store.h"
-#include "thread_safe_vector.h"
 
-constexpr int NUM_PICO = 6;
-constexpr int ADC_PER_PICO = 3;
+// 台数は robot_topology.h の表から決まる．
+constexpr int NUM_PICO = ROBOT_PICO_COUNT;
+constexpr int ADC_PER_PICO = ROBOT_ADC_PER_PICO;
+
+constexpr size_t POT_HISTORY_SIZE = 4096;  // Pico 6台分のフレームで数秒分．
+
+constexpr int NUM_ODRIVE = static_cast<int>(ROBOT_JOINT_COUNT);  // node_id は 1..NUM_ODRIVE．
+
+// 全 Pico の ADC 値．
+using PotValues = std::array<std::array<uint16_t, ADC_PER_PICO>, NUM_PICO>;
+
+// 生の ADC 値と，平滑化した値 (pot_filter.h，ADC 値に丸めたもの) の組．
+struct PotFrame {
+    PotValues raw;
+    PotValues filtered;
+};
+
+// ポテンショメータ値の 1 サンプル．
+// time は最後に反映した Pico フレームのカーネル受信時刻 (now_time_sec() 基準)．
+using PotSample = Stamped<PotFrame>;
 
 inline ThreadSafeStore g_thread_safe_store;
 
-inline ThreadSafeVector<std::array<std::array<uint16_t, ADC_PER_PICO>, NUM_PICO>> g_pot_values(1);  // ロガー用バッファ（16関節分）
+// g_thread_safe_store の型付きキー．main() で Declare してから使う．
+// 標準入力からは同じ名前の文字列キーとして書き換えられる．
+inline constexpr StoreKey<bool> KEY_FIN{"fin", 0};  // このフラグを折ると各スレッドが終了する.
+inline constexpr StoreKey<int> KEY_POT{"pot", 1};  // 送った秒数分ポテンショメータ値を表示する．
+inline constexpr StoreKey<int> KEY_CMD{"cmd", 2};  // 最新のコマンド．
+inline constexpr StoreKey<SystemState> KEY_SYSTEM_STATE{"system_state", 3};  // システム状態.
+
+// Pico フレームを受信するたびに積まれるポテンショメータ値の履歴．
+// 書き込みは CAN 受信スレッドのみ．
+// raw / filtered のどちらを使うかは pot_latest_values() (pot_handler.h) で選べる．
+inline ThreadSafeRing<PotFrame, POT_HISTORY_SIZE> g_pot_values;
+
+// Pico 1 台分の最新のフレーム．
+struct PicoReading {
+    std::array<uint16_t, ADC_PER_PICO> adc;
+    float rate_hz;  // フレームの到着頻度 (受信間隔の移動平均から求めたもの)．
+};
+
+// Pico ごとの最新のフレーム．time はそのフレームのカーネル受信時刻 (now_time_sec() 基準)．
+// 鮮度の確認には pot_age_sec() / pot_is_fresh() (pot_handler.h) を使う．
+// 書き込みは CAN 受信スレッドのみ．
+inline std::array<ThreadSafeRing<PicoReading, 2>, NUM_PICO> g_pico_readings;
+
+// ODrive のエンコーダ推定値 (Get_Encoder_Estimates, cmd 0x009)．
+struct EncoderEstimate {
+    float pos;  // [turn]
+    float vel;  // [turn/s]
+};
+
+// ノードごとの最新のエンコーダ推定値．index は node_id - 1．
+// time はカーネル受信時刻 (now_time_sec() 基準)．書き込みは CAN 受信スレッドのみ．
+inline std::array<ThreadSafeRing<EncoderEstimate, 2>, NUM_ODRIVE> g_encoder_estimates;
+
+// ODrive のハートビート (Heartbeat, cmd 0x001)．odrive_status.h で受信する．
+struct OdriveHeartbeat {
+    uint32_t axis_error;
+    uint8_t axis_state;
+    uint8_t procedure_result;  // ファームウェア 0.6 以降 (0.5 ではモータのエラーフラグ)．0 なら正常．
+};
+
+// ノードごとの最新のハートビート．index は node_id - 1．
+// time はカーネル受信時刻 (now_time_sec() 基準)．書き込みは CAN 受信スレッドのみ．
+inline std::array<ThreadSafeRing<OdriveHeartbeat, 2>, NUM_ODRIVE> g_odrive_heartbeats;
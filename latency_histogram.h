@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+
+// 対数線形のヒストグラム (HDR Histogram と同じ考え方)．値は非負の整数 (ns など)．
+// 2^k ごとの区間を kSubBuckets 個に等分するので，どの値でも相対誤差は 1/kSubBuckets 以下．
+// 固定長の配列だけを使うので，Record() でメモリ確保は起きない．
+// Record() は 1 スレッドから呼び，集計はそのスレッドが止まってから行うこと．
+class LatencyHistogram final {
+public:
+    void Record(const uint64_t value) {
+        ++counts_[IndexOf(value)];
+        ++count_;
+        sum_ += static_cast<double>(value);
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void Reset() { *this = LatencyHistogram{}; }
+
+    uint64_t Count() const { return count_; }
+    uint64_t Min() const { return (count_ == 0) ? 0 : min_; }
+    uint64_t Max() const { return max_; }
+    double Mean() const { return (count_ == 0) ? 0.0 : sum_ / static_cast<double>(count_); }
+
+    // p パーセンタイル (0..100) を含む区間の上端．
+    uint64_t Percentile(const double p) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        const double clamped = std::min(std::max(p, 0.0), 100.0);
+        const auto rank = static_cast<uint64_t>(clamped / 100.0 * static_cast<double>(count_ - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return std::min(UpperBoundOf(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    // "[TAG] name: n=.. mean=.. p50=.. p90=.. p99=.. p99.9=.. max=.. unit" の 1 行を出力する．
+    // scale は表示単位への換算係数 (ns を us で表示するなら 1e-3)．
+    void Print(std::ostream& os, const char* prefix, const char* unit, const double scale) const {
+        const auto flags = os.flags();
+        os << prefix << " n=" << count_ << std::fixed << std::setprecision(1)
+           << " mean=" << Mean() * scale
+           << " p50=" << Percentile(50.0) * scale
+           << " p90=" << Percentile(90.0) * scale
+           << " p99=" << Percentile(99.0) * scale
+           << " p99.9=" << Percentile(99.9) * scale
+           << " max=" << Max() * scale << " " << unit << std::endl;
+        os.flags(flags);
+    }
+
+private:
+    static constexpr int kSubBits = 4;
+    static constexpr uint64_t kSubBuckets = uint64_t{1} << kSubBits;
+    static constexpr size_t kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+    static size_t IndexOf(const uint64_t value) {
+        if (value < kSubBuckets) {
+            return static_cast<size_t>(value);
+        }
+        const int msb = 63 - __builtin_clzll(value);
+        const int shift = msb - kSubBits;
+        const uint64_t sub = (value >> shift) - kSubBuckets;
+        return static_cast<size_t>((shift + 1) * kSubBuckets + sub);
+    }
+
+    static uint64_t UpperBoundOf(const size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        const int shift = static_cast<int>(index / kSubBuckets) - 1;
+        const uint64_t sub = index % kSubBuckets;
+        return ((kSubBuckets + sub + 1) << shift) - 1;
+    }
+
+    std::array<uint64_t, kBuckets> counts_{};
+    uint64_t count_ = 0;
+    double sum_ = 0.0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+// UDJ1 コマンドロガーのバイナリ形式 (log_udp_*.bin) の定義．
+// ゲートウェイ本体と変換ツール (tools/udj1_log2csv.cpp) の両方から使う．
+//
+// ファイルは UdjLogHeader (header_size バイト) の後に，row_size バイトの行が続く．
+// 1 行は double time, float joint[joint_count], uint32_t flags,
+// uint32_t seq, uint64_t sender_ns, float tx_latency_us をこの順に並べたもの．
+// (version 1 は joint まで，version 2 は flags まで．)
+// seq / sender_ns は UDJ1 version 2 のパケット (udj1_protocol.h) のときだけ入る (UDJ_LOG_FLAG_HAS_SEQ)．
+// tx_latency_us は受信してから CAN の送信スケジューラ (can_tx.h) に積むまでの時間．CAN に送らなかった行は 0．
+// 値はすべてリトルエンディアン，パディング無し．
+
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "binary log is written in host byte order and assumes little endian");
+
+constexpr char UDJ_LOG_MAGIC[4] = {'U', 'D', 'J', 'L'};
+constexpr uint16_t UDJ_LOG_VERSION = 3;
+
+// 行の flags．
+constexpr uint32_t UDJ_LOG_FLAG_COALESCED = 1u << 0;  // より新しいパケットがあったため CAN に送らなかった.
+constexpr uint32_t UDJ_LOG_FLAG_REORDERED = 1u << 1;  // 通し番号が最新より古かったため CAN に送らなかった.
+constexpr uint32_t UDJ_LOG_FLAG_DUPLICATE = 1u << 2;  // 受信済みの通し番号だったため CAN に送らなかった.
+constexpr uint32_t UDJ_LOG_FLAG_HAS_SEQ   = 1u << 3;  // seq / sender_ns が有効.
+
+#pragma pack(push, 1)
+struct UdjLogHeader {
+    char magic[4];             // "UDJL"
+    uint16_t version;          // UDJ_LOG_VERSION
+    uint16_t joint_count;      // 1 行あたりの関節数.
+    uint32_t header_size;      // このヘッダのバイト数 (行データの開始位置).
+    uint32_t row_size;         // 1 行のバイト数.
+    int64_t epoch_unix_ns;     // time = 0 に対応する壁時計 (UNIX 時刻, ns).
+    float nominal_rate_hz;     // 想定するコマンド周期 (記録用，0 なら不明).
+    uint32_t reserved;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(UdjLogHeader) == 32, "UdjLogHeader layout changed");
+
+// 行の中で joint の後ろに続く部分 (version 3)．
+#pragma pack(push, 1)
+struct UdjLogRowTail {
+    uint32_t flags;
+    uint32_t seq;
+    uint64_t sender_ns;
+    float tx_latency_us;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(UdjLogRowTail) == 20, "UdjLogRowTail layout changed");
+
+constexpr uint32_t udj_log_row_size(const uint16_t joint_count, const uint16_t version = UDJ_LOG_VERSION) {
+    return sizeof(double) + sizeof(float) * joint_count
+         + (version >= 3 ? sizeof(UdjLogRowTail) : version == 2 ? sizeof(uint32_t) : 0);
+}
+
+// CSV の見出し行．ゲートウェイが直接書く CSV と変換ツールの出力で形式をそろえるために共通化している．
+inline void udj_log_write_csv_header(std::ostream& os, const uint16_t joint_count, const uint16_t version) {
+    os << "time";
+    for (int i = 0; i < joint_count; i++) os << ",joint_" << i;
+    if (version >= 2) os << ",coalesced";
+    if (version >= 3) os << ",reordered,duplicate,seq,sender_time,tx_latency_us";
+    os << "\n";
+}
+
+// CSV の 1 行．version 1 / 2 では tail のうち存在する部分だけを出す．
+// seq / sender_time は UDJ_LOG_FLAG_HAS_SEQ が無ければ空欄にする．
+inline void udj_log_write_csv_row(std::ostream& os, const double time, const float* joint,
+                                  const uint16_t joint_count, const uint16_t version,
+                                  const UdjLogRowTail& tail) {
+    os << std::fixed << std::setprecision(6) << time;
+    for (int i = 0; i < joint_count; i++) os << "," << joint[i];
+    if (version >= 2) {
+        os << "," << ((tail.flags & UDJ_LOG_FLAG_COALESCED) ? 1 : 0);
+    }
+    if (version >= 3) {
+        os << "," << ((tail.flags & UDJ_LOG_FLAG_REORDERED) ? 1 : 0)
+           << "," << ((tail.flags & UDJ_LOG_FLAG_DUPLICATE) ? 1 : 0) << ",";
+        if (tail.flags & UDJ_LOG_FLAG_HAS_SEQ) {
+            os << tail.seq << "," << static_cast<double>(tail.sender_ns) * 1e-9;
+        } else {
+            os << ",";
+        }
+        os << "," << tail.tx_latency_us;
+    }
+    os << "\n";
+}
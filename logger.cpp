@@ -1,39 +1,113 @@
 #include "logger.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <array>
 #include <atomic>
+#include <cerrno>
 #include <chrono>
 #include <ctime>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <mutex>
-#include <queue>
 #include <thread>
 #include <vector>
 
 #include "thread_priority.h"
-#include "global_variable.h"
+#include "log_format.h"
+#include "robot_topology.h"
+#include "spsc_queue.h"
+#include "time_utils.h"
 
-constexpr int JOINT_NUM = 16;
+constexpr int JOINT_NUM = static_cast<int>(ROBOT_JOINT_COUNT);
 constexpr double FLUSH_INTERVAL = 0.3;
 const char* LOG_DIR = "logs";
 
+// バイナリ形式で，この量がたまったら FLUSH_INTERVAL を待たずに書き出す.
+constexpr size_t BINARY_WRITE_CHUNK = 256 * 1024;
+
+// UDJ1 スレッドから書き込みスレッドへ渡すキューの容量．あふれた行は捨てて数える．
+constexpr size_t LOG_QUEUE_CAPACITY = 8192;
+
+// キューにこれだけたまったら，書き込みスレッドを起こす.
+constexpr size_t LOG_WAKE_THRESHOLD = 256;
+
 struct LogRow {
     double time;
     float joint[JOINT_NUM];
+    UdjLogRowTail tail;
 };
 
-static std::queue<LogRow> log_queue;
-static std::mutex log_mutex;
+// logger_push() は優先度の高い UDJ1 スレッドから呼ばれるので，ロックを取らないキューを使う.
+static SpscQueue<LogRow, LOG_QUEUE_CAPACITY> log_queue;
+static int wake_fd = -1;  // 書き込みスレッドを起こす eventfd.
+
+// logger_push() 側の統計．書き込みは UDJ1 スレッドのみ.
+static std::atomic<uint64_t> pushed_rows{0};
+static std::atomic<uint64_t> dropped_rows{0};
+static std::atomic<size_t> high_watermark{0};
+
 static std::atomic<bool> running{false};
 static std::thread writer_thread;
+static LogFormat log_format = LogFormat::kCsv;
 
-static double now_sec() {
-    using clock = std::chrono::steady_clock;
-    static const auto t0 = clock::now();
-    return std::chrono::duration<double>(clock::now() - t0).count();
+static void wake_writer() {
+    const uint64_t one = 1;
+    write(wake_fd, &one, sizeof(one));
+}
+
+static bool write_all(const int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        const ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static int open_binary_log(const std::string& path) {
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // time = 0 (now_time_sec() の基準) に対応する壁時計を記録しておく.
+    const auto wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    const auto mono_ns = static_cast<int64_t>(now_time_sec() * 1e9);
+
+    UdjLogHeader header{};
+    std::memcpy(header.magic, UDJ_LOG_MAGIC, sizeof(header.magic));
+    header.version = UDJ_LOG_VERSION;
+    header.joint_count = JOINT_NUM;
+    header.header_size = sizeof(UdjLogHeader);
+    header.row_size = udj_log_row_size(JOINT_NUM);
+    header.epoch_unix_ns = wall_ns - mono_ns;
+    // 行は UDJ1 パケットの受信ごとに書くので，周期は送信側しだいで分からない.
+    header.nominal_rate_hz = 0.0f;
+
+    if (!write_all(fd, reinterpret_cast<const uint8_t*>(&header), sizeof(header))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void append_binary_row(std::vector<uint8_t>& out, const LogRow& r) {
+    const size_t off = out.size();
+    out.resize(off + udj_log_row_size(JOINT_NUM));
+    std::memcpy(&out[off], &r.time, sizeof(double));
+    std::memcpy(&out[off + sizeof(double)], r.joint, sizeof(float) * JOINT_NUM);
+    std::memcpy(&out[off + sizeof(double) + sizeof(float) * JOINT_NUM], &r.tail, sizeof(UdjLogRowTail));
 }
 
 static void writer_loop() {
@@ -47,71 +121,140 @@ static void writer_loop() {
     std::tm tm_buf{};
     localtime_r(&tt, &tm_buf);
     std::strftime(ts_buf.data(), ts_buf.size(), "%Y%m%d_%H%M%S", &tm_buf);
-    const std::string log_path = std::string(LOG_DIR) + "/log_udp_" + ts_buf.data() + ".csv";
 
-    std::ofstream ofs(log_path);
-    
-    if (!ofs.is_open()) {
-    std::cerr << "[LOGGER] file open failed" << std::endl;
-	}
-    ofs << "time";
-    for (int i = 0; i < JOINT_NUM; i++) ofs << ",joint_" << i;
-    ofs << "\n";
+    const bool binary = (log_format == LogFormat::kBinary);
+    const std::string log_path = std::string(LOG_DIR) + "/log_udp_" + ts_buf.data()
+                               + (binary ? ".bin" : ".csv");
+
+    std::ofstream ofs;
+    int fd = -1;
+    std::vector<uint8_t> bin_buf;
+
+    if (binary) {
+        fd = open_binary_log(log_path);
+        if (fd < 0) {
+            std::cerr << "[LOGGER] file open failed" << std::endl;
+        }
+        bin_buf.reserve(BINARY_WRITE_CHUNK + udj_log_row_size(JOINT_NUM));
+    } else {
+        ofs.open(log_path);
+        if (!ofs.is_open()) {
+        std::cerr << "[LOGGER] file open failed" << std::endl;
+        }
+        udj_log_write_csv_header(ofs, JOINT_NUM, UDJ_LOG_VERSION);
+    }
 
     std::vector<LogRow> buffer;
     auto last_flush = std::chrono::steady_clock::now();
 
-    while (!g_thread_safe_store.Get<bool>("fin") && (running || !log_queue.empty())) {
-        {
-            std::lock_guard<std::mutex> lk(log_mutex);
-            while (!log_queue.empty()) {
-                buffer.push_back(log_queue.front());
-                log_queue.pop();
+    const int wait_ms = static_cast<int>(FLUSH_INTERVAL * 1000);
+
+    while (running || !log_queue.Empty()) {
+        log_queue.PopAll([&](const LogRow& r) { buffer.push_back(r); });
+
+        if (binary) {
+            // 変換は memcpy だけなので，受け取ったそばから詰めておく.
+            for (const auto& r : buffer) {
+                append_binary_row(bin_buf, r);
             }
+            buffer.clear();
         }
 
         auto now = std::chrono::steady_clock::now();
-        if (!buffer.empty() &&
-            std::chrono::duration<double>(now - last_flush).count() >= FLUSH_INTERVAL) {
+        const bool interval_elapsed =
+            std::chrono::duration<double>(now - last_flush).count() >= FLUSH_INTERVAL;
 
+        if (binary) {
+            if (!bin_buf.empty() && (interval_elapsed || bin_buf.size() >= BINARY_WRITE_CHUNK)) {
+                if (fd >= 0 && !write_all(fd, bin_buf.data(), bin_buf.size())) {
+                    std::cerr << "[LOGGER] write failed" << std::endl;
+                }
+                bin_buf.clear();
+                last_flush = now;
+            }
+        } else if (!buffer.empty() && interval_elapsed) {
             for (auto& r : buffer) {
-                ofs << std::fixed << std::setprecision(6) << r.time;
-                for (float v : r.joint) ofs << "," << v;
-                ofs << "\n";
+                udj_log_write_csv_row(ofs, r.time, r.joint, JOINT_NUM, UDJ_LOG_VERSION, r.tail);
             }
             ofs.flush();
             buffer.clear();
             last_flush = now;
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        // 行がたまるか，次の書き出し時刻になるまで眠る.
+        if (running && log_queue.Size() < LOG_WAKE_THRESHOLD) {
+            pollfd pfd{wake_fd, POLLIN, 0};
+            if (poll(&pfd, 1, wait_ms) > 0) {
+                uint64_t count = 0;
+                read(wake_fd, &count, sizeof(count));
+            }
+        }
+    }
+
+    if (!binary && !buffer.empty()) {
+        for (auto& r : buffer) {
+            udj_log_write_csv_row(ofs, r.time, r.joint, JOINT_NUM, UDJ_LOG_VERSION, r.tail);
+        }
+        ofs.flush();
+    }
+
+    if (fd >= 0) {
+        if (!bin_buf.empty() && !write_all(fd, bin_buf.data(), bin_buf.size())) {
+            std::cerr << "[LOGGER] write failed" << std::endl;
+        }
+        close(fd);
     }
 }
 
-void start_logger_thread() {
+void start_logger_thread(const LogFormat format) {
 	std::cout << "[LOGGER] start / ログ書き込み開始." << std::endl;
+    log_format = format;
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        std::cerr << "[LOGGER] eventfd() failed" << std::endl;
+    }
     running = true;
     writer_thread = std::thread(writer_loop);
 }
 
 void stop_logger_thread() {
-    // 書き込みを終了する．(loopが終了する．)
+    // 書き込みを終了する．(キューを書き出しきったら loop が終了する．)
     running = false;
+    wake_writer();
 
     // 書き込みスレッドの終了を待つ．
     if (writer_thread.joinable()) {
         writer_thread.join();
     }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+
+    std::cout << "[LOGGER] rows pushed=" << pushed_rows
+              << " dropped=" << dropped_rows
+              << " high_watermark=" << high_watermark
+              << "/" << LOG_QUEUE_CAPACITY << std::endl;
     std::cout << "[LOGGER] stopped / 終了しました." << std::endl;
 }
 
-void logger_push(double time, const float* joint) {
+void logger_push(double time, const float* joint, const UdjLogRowTail& tail) {
     LogRow r{};
     r.time = time;
+    r.tail = tail;
     std::memcpy(r.joint, joint, sizeof(float) * JOINT_NUM);
 
-    std::lock_guard<std::mutex> lk(log_mutex);
-    if (log_queue.size() < 5000) {
-        log_queue.push(r);
+    if (!log_queue.TryPush(r)) {
+        dropped_rows.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    pushed_rows.fetch_add(1, std::memory_order_relaxed);
+
+    const size_t depth = log_queue.Size();
+    if (depth > high_watermark.load(std::memory_order_relaxed)) {
+        high_watermark.store(depth, std::memory_order_relaxed);
+    }
+    if (depth == LOG_WAKE_THRESHOLD) {
+        wake_writer();
     }
 }
@@ -1,5 +1,14 @@
 #pragma once
 
-void start_logger_thread();
+// ログの書き出し形式．
+enum class LogFormat {
+    kCsv,     // logs/log_udp_*.csv (テキスト)
+    kBinary,  // logs/log_udp_*.bin (log_format.h 参照．tools/udj1_log2csv で CSV に戻せる)
+};
+
+void start_logger_thread(LogFormat format = LogFormat::kCsv);
 void stop_logger_thread();
-void logger_push(double time, const float* joint);
+#include "log_format.h"
+
+// tail には flags (UDJ_LOG_FLAG_*)，通し番号，送信時刻，CAN 書き込みまでの時間を入れる (log_format.h)．
+void logger_push(double time, const float* joint, const UdjLogRowTail& tail = {});
@@ -1,42 +1,225 @@
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
+#include "can_rx.h"
+#include "can_topology.h"
 #include "can_utils.h"
 #include "ctrl_manager.h"
 #include "logger.h"
+#include "output_scheduler.h"
 #include "pot_handler.h"
+#include "reactor.h"
 #include "udj1_handler.h"
 #include "encoder_logger.h"
+#include "odrive_status.h"
 #include "thread_safe_store.h"
 #include "stdin_writer.h"
+#include "setpoint_suppressor.h"
+#include "telemetry_publisher.h"
 #include "global_variable.h"
 
-int main() {
+// 起動オプション.
+//   --reactor : 全ての通信を 1 本のイベントループ (epoll) で処理する．
+//   (指定なし) : 従来通り，モジュールごとにスレッドを起動する．
+//   --output-rate=HZ : UDJ1 の受信に合わせず，HZ の固定周期で CAN に指令値を送る．
+//   --output-cpu=N   : 周期送信スレッドを CPU コア N に固定する．
+//   --interp=MODE    : 周期送信の補間方法 (hold / linear / cubic)．既定は hold．
+//   --telemetry=IP:PORT   : エンコーダ推定値を IP:PORT へ UDP で送る (telemetry_publisher.h)．
+//   --telemetry-rate=HZ   : その送信周期．既定は 100 Hz．
+//   --zero-calib=POLICY   : ゼロ点合わせで同時に動かす脚 (leg / diagonal / all)．既定は leg．
+//   --calib-file=PATH     : ゼロ点合わせの結果を保存するファイル．既定は calibration.bin．
+//   --no-warm-start       : 起動時に保存した結果を使わず，必ず cmd=1 からキャリブレーションする．
+//   --suppress-eps=ROT[,ROT...] : 前回送った値からの変化が ROT 未満の関節を送らない (関節ごとに指定可)．
+//   --suppress-refresh=SEC      : その場合も，SEC ごとには送り直す．既定は 0.1 秒．
+//   --can-bus=IF:NODES[,IF:NODES...] : ODrive の node_id をつながっている CAN インタフェースに割り当てる
+//                                     (例: can0:1-12,can1:13-16)．既定は全ノード can0 (can_topology.h)．
+//   --pico-bus=IF                    : Pico がつながっているインタフェース．既定は先頭のインタフェース．
+//   --log-format=FORMAT   : UDJ1 のログの形式 (csv / binary)．既定は csv (logger.h)．
+static bool has_option(const int argc, char** argv, const char* name) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// "--name=value" 形式のオプションの値を返す．無ければ nullptr.
+static const char* option_value(const int argc, char** argv, const char* name) {
+    const size_t len = std::strlen(name);
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], name, len) == 0 && argv[i][len] == '=') {
+            return argv[i] + len + 1;
+        }
+    }
+    return nullptr;
+}
+
+constexpr double MAX_RATE_HZ = 100000.0;  // --output-rate / --telemetry-rate の上限.
+
+// 数値のオプションを末尾まで解釈する．"1k" や範囲外なら false.
+static bool parse_double_option(const char* text, const double min_exclusive, const double max, double& out) {
+    char* end = nullptr;
+    const double value = std::strtod(text, &end);
+    if (end == text || *end != '\0' || !(value > min_exclusive && value <= max)) {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+static bool parse_int_option(const char* text, const long min, const long max, int& out) {
+    char* end = nullptr;
+    const long value = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || value < min || value > max) {
+        return false;
+    }
+    out = static_cast<int>(value);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const bool reactor_mode = has_option(argc, argv, "--reactor");
+    const char* output_rate = option_value(argc, argv, "--output-rate");
+    const char* output_cpu = option_value(argc, argv, "--output-cpu");
+    const char* interp = option_value(argc, argv, "--interp");
+    const char* telemetry = option_value(argc, argv, "--telemetry");
+    const char* telemetry_rate = option_value(argc, argv, "--telemetry-rate");
+    const char* zero_calib = option_value(argc, argv, "--zero-calib");
+    const char* calib_file = option_value(argc, argv, "--calib-file");
+    const bool warm_start = !has_option(argc, argv, "--no-warm-start");
+    const char* suppress_eps = option_value(argc, argv, "--suppress-eps");
+    const char* suppress_refresh = option_value(argc, argv, "--suppress-refresh");
+    const char* log_format = option_value(argc, argv, "--log-format");
+
     std::cout << "[GW] Gateway Start. / ゲートウエイマイコンを起動します." << std::endl;
     std::cout << "[GW] Start threads. / 通信スレッドを起動します." << std::endl;
 
+    if (zero_calib != nullptr) {
+        ZeroCalibPolicy policy{};
+        if (parse_zero_calib_policy(zero_calib, policy)) {
+            ctrl_set_zero_calib_policy(policy);
+        } else {
+            std::cerr << "[GW] unknown --zero-calib: " << zero_calib << std::endl;
+        }
+    }
+    if (suppress_eps != nullptr) {
+        SuppressionConfig suppression;
+        if (parse_suppression_config(suppress_eps, suppress_refresh, suppression)) {
+            udj1_set_change_suppression(suppression);
+            output_scheduler_set_change_suppression(suppression);
+        } else {
+            std::cerr << "[GW] invalid --suppress-eps / --suppress-refresh" << std::endl;
+        }
+    }
+    LogFormat log_format_value = LogFormat::kCsv;
+    if (log_format != nullptr) {
+        if (std::strcmp(log_format, "binary") == 0) {
+            log_format_value = LogFormat::kBinary;
+        } else if (std::strcmp(log_format, "csv") != 0) {
+            std::cerr << "[GW] unknown --log-format: " << log_format << std::endl;
+        }
+    }
+    ctrl_set_calibration_file(calib_file ? calib_file : "calibration.bin", warm_start);
+
+    // CAN インタフェースの割り当ては，受信ハンドラの登録と CAN 通信の初期化より前に決める.
+    const char* can_bus = option_value(argc, argv, "--can-bus");
+    const char* pico_bus = option_value(argc, argv, "--pico-bus");
+    if (can_bus != nullptr || pico_bus != nullptr) {
+        CanTopology topology;
+        if (!parse_can_topology(can_bus, pico_bus, topology)) {
+            return 1;
+        }
+        can_set_topology(topology);
+    }
+    can_topology_print();
+
     // まず，CAN通信を初期化.
-    can_init("can0");
-
-    g_thread_safe_store.Set<bool>("fin", false);  // このフラグを折ると各スレッドが終了する.
-    g_thread_safe_store.Set<int>("pot", 0);  // 送った秒数分ポテンショメータ値を表示する．
-    g_thread_safe_store.Set<int>("cmd", 0);  // 
-    g_thread_safe_store.Set<SystemState>("system_state", SystemState::INIT);  // システム状態.
-
-    // その後, 各種スレッドを起動.
-    start_pot_thread();
-    start_ctrl_thread();
-    start_udj1_thread();
-	start_logger_thread();
+    can_init();
+
+    g_thread_safe_store.Declare(KEY_FIN, false);  // このフラグを折ると各スレッドが終了する.
+    g_thread_safe_store.Declare(KEY_POT, 0);  // 送った秒数分ポテンショメータ値を表示する．
+    g_thread_safe_store.Declare(KEY_CMD, 0);  // 
+    g_thread_safe_store.Declare(KEY_SYSTEM_STATE, SystemState::INIT);  // システム状態.
+
+    // ログの書き込みスレッドはどちらのモードでも起動する.
+	start_logger_thread(log_format_value);
     start_encoder_logger_thread();
+    odrive_status_register_handlers();  // キャリブレーション完了の判定に使う.
+
+    // 周期送信は指定があるときだけ．UDJ1 スレッドと同じ優先度より少し上で回す.
+    // 解釈できない値は，黙って既定に戻さずにエラーを表示する (送信方法が変わってしまうため).
+    if (output_rate != nullptr) {
+        double rate_hz = 0.0;
+        int cpu = -1;
+        InterpMode mode = InterpMode::kHold;
+        bool valid = true;
+        if (!parse_double_option(output_rate, 0.0, MAX_RATE_HZ, rate_hz)) {
+            std::cerr << "[GW] invalid --output-rate: " << output_rate
+                      << " (0 < HZ <= " << MAX_RATE_HZ << ")" << std::endl;
+            valid = false;
+        }
+        if (output_cpu != nullptr && !parse_int_option(output_cpu, 0, sysconf(_SC_NPROCESSORS_CONF) - 1, cpu)) {
+            std::cerr << "[GW] invalid --output-cpu: " << output_cpu << std::endl;
+            valid = false;
+        }
+        if (interp != nullptr && std::strcmp(interp, "linear") == 0) {
+            mode = InterpMode::kLinear;
+        } else if (interp != nullptr && std::strcmp(interp, "cubic") == 0) {
+            mode = InterpMode::kCubic;
+        } else if (interp != nullptr && std::strcmp(interp, "hold") != 0) {
+            std::cerr << "[GW] unknown --interp: " << interp << std::endl;
+            valid = false;
+        }
+        if (valid) {
+            start_output_scheduler(rate_hz, 85, cpu, mode);
+        } else {
+            std::cerr << "[GW] output scheduler not started / 周期送信は行いません (UDJ1 の受信ごとに送信します)．"
+                      << std::endl;
+        }
+    }
+
+    if (telemetry != nullptr) {
+        double rate_hz = 100.0;
+        if (telemetry_rate != nullptr && !parse_double_option(telemetry_rate, 0.0, MAX_RATE_HZ, rate_hz)) {
+            std::cerr << "[GW] invalid --telemetry-rate: " << telemetry_rate
+                      << " (0 < HZ <= " << MAX_RATE_HZ << ")" << std::endl;
+        } else {
+            start_telemetry_publisher(telemetry, rate_hz);
+        }
+    }
+
+    if (reactor_mode) {
+        run_reactor();  // fin=1 か標準入力が閉じるまで戻らない.
+        g_thread_safe_store.Set(KEY_FIN, true);
+
+        std::cout << "[GW] Stopping threads. / 通信スレッドを終了します." << std::endl;
+    } else {
+        // その後, 各種スレッドを起動.
+        start_pot_thread();
+        start_ctrl_thread();
+        start_udj1_thread();
+
+        // 受信ハンドラが出そろってから CAN 受信を開始する.
+        can_rx_start();
+
+        std::cout << "[GW] All threads started. / 全ての通信スレッドを起動しました." << std::endl;
+        StdinWriter{}.Run();  // 標準入力からのコマンドを処理する．
+        g_thread_safe_store.Set(KEY_FIN, true);  // 標準入力が閉じた場合も終了させる.
+
+        // スレッドの終了を待つ.
+        std::cout << "[GW] Stopping threads. / 通信スレッドを終了します." << std::endl;
+        can_rx_stop();
+        stop_pot_thread();
+        stop_ctrl_thread();
+        stop_udj1_thread();
+    }
 
-    std::cout << "[GW] All threads started. / 全ての通信スレッドを起動しました." << std::endl;
-    StdinWriter{}.Run();  // 標準入力からのコマンドを処理する．
-    
-    // スレッドの終了を待つ.
-    std::cout << "[GW] Stopping threads. / 通信スレッドを終了します." << std::endl;
-    stop_pot_thread();
-    stop_ctrl_thread();
-    stop_udj1_thread();
+    stop_output_scheduler();
+    stop_telemetry_publisher();
 	stop_logger_thread();
     stop_encoder_logger_thread();
 
@@ -0,0 +1,49 @@
+#include "odrive_status.h"
+
+#include <linux/can.h>
+
+#include <cstring>
+
+#include "can_rx.h"
+#include "can_topology.h"
+#include "global_variable.h"
+
+namespace {
+constexpr uint16_t kCmdHeartbeat = 0x001;
+
+// CAN 受信スレッド (can_rx) 上で呼ばれる．
+// data: axis_error (u32) axis_state (u8) procedure_result (u8) ...
+void on_heartbeat(const can_frame& frame, const double rx_time) {
+    if (frame.can_dlc < 6) {
+        return;
+    }
+    const int node_id = static_cast<int>((frame.can_id >> 5) & 0x3F);
+    if (node_id < 1 || node_id > NUM_ODRIVE) {
+        return;
+    }
+
+    OdriveHeartbeat hb{};
+    std::memcpy(&hb.axis_error, &frame.data[0], 4);
+    hb.axis_state = frame.data[4];
+    hb.procedure_result = frame.data[5];
+    g_odrive_heartbeats[node_id - 1].Push(rx_time, hb);
+}
+}  // namespace
+
+void odrive_status_register_handlers() {
+    // Heartbeat (cmd 0x001) を，各ノードがつながっているインタフェースで受け取る．
+    // node_id を含めた ID で登録する (cmd だけのマスクでは Pico の応答 0x301 も当てはまってしまう).
+    for (int node_id = 1; node_id <= NUM_ODRIVE; ++node_id) {
+        can_rx_register((static_cast<uint32_t>(node_id) << 5) | kCmdHeartbeat, CAN_SFF_MASK, on_heartbeat,
+                        static_cast<int>(can_bus_of_node(node_id)));
+    }
+}
+
+bool odrive_heartbeat_since(const int node_id, const double time, OdriveHeartbeat& out) {
+    const auto latest = g_odrive_heartbeats[node_id - 1].Latest();
+    if (!latest || latest->time < time) {
+        return false;
+    }
+    out = latest->value;
+    return true;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+// ODrive のハートビート (cmd 0x001) を受信して，ノードごとの最新値を
+// g_odrive_heartbeats (global_variable.h) に反映するモジュール．
+
+struct OdriveHeartbeat;
+
+constexpr uint8_t ODRIVE_AXIS_STATE_IDLE = 1;
+
+// ハートビートの受信ハンドラを登録する．can_rx_start() / can_rx_open() より前に呼ぶこと．
+void odrive_status_register_handlers();
+
+// node_id (1..NUM_ODRIVE) のハートビートを time 以降に受信していれば，out に書いて true を返す．
+bool odrive_heartbeat_since(int node_id, double time, OdriveHeartbeat& out);
@@ -0,0 +1,196 @@
+#include "output_scheduler.h"
+
+#include <time.h>
+
+#include <cerrno>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "can_tx.h"
+#include "can_utils.h"
+#include "global_variable.h"
+#include "latency_histogram.h"
+#include "setpoint_interpolator.h"
+#include "setpoint_suppressor.h"
+#include "thread_priority.h"
+#include "thread_safe_ring.h"
+#include "time_utils.h"
+
+namespace {
+constexpr size_t kMaxJoints = CAN_MAX_BATCH_NODES;
+
+struct Setpoints {
+    size_t count;
+    std::array<float, kMaxJoints> angles;
+};
+
+// UDJ1 スレッドが書き，送信スレッドが最新値だけを読む.
+ThreadSafeRing<Setpoints, 4> latest_setpoints;
+
+std::thread output_thread;
+std::atomic<bool> running{false};
+std::atomic<bool> enabled{false};
+
+int64_t period_ns = 0;
+int thread_priority = 0;
+int thread_cpu = -1;
+InterpMode interp_mode = InterpMode::kHold;
+SuppressionConfig suppression;
+
+// 統計．送信スレッドだけが書き，停止後に表示する.
+LatencyHistogram wakeup_latency;  // 予定時刻からの起床遅れ [ns].
+LatencyHistogram setpoint_age;    // 送った時点での，最新の指令値の受信からの経過時間 [ns].
+uint64_t cycles = 0;
+uint64_t overruns = 0;           // 1 周期以上遅れて起きた回数.
+uint64_t skipped_cycles = 0;     // overrun で飛ばした周期の数.
+uint64_t sent_cycles = 0;
+uint64_t extrapolated_cycles = 0;  // 指令値の到着が遅れて外挿・保持した周期の数.
+uint64_t sent_frames = 0;          // 送信スケジューラに積んだ位置指令の数.
+uint64_t suppressed_frames = 0;    // 変化が小さいため送らなかったフレームの数.
+
+int64_t to_ns(const timespec& ts) {
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+timespec from_ns(const int64_t ns) {
+    timespec ts{};
+    ts.tv_sec = static_cast<time_t>(ns / 1000000000LL);
+    ts.tv_nsec = static_cast<long>(ns % 1000000000LL);
+    return ts;
+}
+
+void output_loop() {
+    set_cpu_affinity(thread_cpu);
+    set_fifo_priority(thread_priority);
+
+    SetpointInterpolator<kMaxJoints> interpolator(interp_mode, MAX_EXTRAPOLATION_SEC);
+    std::array<float, kMaxJoints> out{};
+    SetpointSuppressor<kMaxJoints> suppressor;
+    suppressor.Configure(suppression);
+
+    bool was_running = false;
+    double run_since = 0.0;  // RUN に入った時刻．これより古い指令値は送らない.
+
+    timespec now_ts{};
+    clock_gettime(CLOCK_MONOTONIC, &now_ts);
+    int64_t next = to_ns(now_ts) + period_ns;
+
+    while (running) {
+        const timespec next_ts = from_ns(next);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_ts, nullptr) == EINTR) {
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now_ts);
+        const int64_t late = to_ns(now_ts) - next;
+        wakeup_latency.Record(late > 0 ? static_cast<uint64_t>(late) : 0);
+        ++cycles;
+
+        // 1 周期以上遅れたら，溜まった周期をまとめて飛ばして現在に合わせる.
+        next += period_ns;
+        if (late >= period_ns) {
+            const int64_t missed = late / period_ns;
+            ++overruns;
+            skipped_cycles += static_cast<uint64_t>(missed);
+            next += missed * period_ns;
+        }
+
+        const bool is_running = g_thread_safe_store.Get(KEY_SYSTEM_STATE, std::memory_order_relaxed)
+                              == SystemState::RUN;
+        const double now = now_time_sec();
+        if (is_running && !was_running) {
+            run_since = now;
+            interpolator.Reset();
+            suppressor.Reset();
+        }
+        was_running = is_running;
+        if (!is_running) {
+            continue;
+        }
+
+        const auto sp = latest_setpoints.Latest();
+        if (sp && sp->time >= run_since && sp->time > interpolator.LastTime()) {
+            interpolator.Push(sp->time, sp->value.angles.data(), sp->value.count);
+        }
+        if (interpolator.Empty()) {
+            continue;
+        }
+
+        if (interp_mode != InterpMode::kHold && now - interpolator.Interval() >= interpolator.LastTime()) {
+            ++extrapolated_cycles;
+        }
+        const size_t n = interpolator.Evaluate(now, out.data());
+        suppressor.Forget(can_tx_take_dropped_setpoints());
+        const uint32_t mask = suppressor.Select(now, out.data(), n);
+        send_positions(out.data(), n, mask);
+        suppressor.Commit(now, out.data(), n, mask);
+        sent_frames += static_cast<uint64_t>(__builtin_popcount(mask));
+        setpoint_age.Record(static_cast<uint64_t>(std::max(now_time_sec() - interpolator.LastTime(), 0.0) * 1e9));
+        ++sent_cycles;
+    }
+    suppressed_frames = suppressor.Suppressed();
+}
+
+void print_stats() {
+    std::cout << "[OUT] cycles=" << cycles << " sent=" << sent_cycles
+              << " overruns=" << overruns << " skipped=" << skipped_cycles
+              << " extrapolated=" << extrapolated_cycles
+              << " frames=" << sent_frames << " suppressed=" << suppressed_frames << std::endl;
+    wakeup_latency.Print(std::cout, "[OUT] wakeup latency:", "us", 1e-3);
+    if (setpoint_age.Count() > 0) {
+        setpoint_age.Print(std::cout, "[OUT] rx -> CAN write:", "us", 1e-3);
+    }
+}
+}  // namespace
+
+void start_output_scheduler(const double rate_hz, const int priority, const int cpu, const InterpMode mode) {
+    if (rate_hz <= 0.0) {
+        return;
+    }
+
+    period_ns = static_cast<int64_t>(1e9 / rate_hz);
+    thread_priority = priority;
+    thread_cpu = cpu;
+    interp_mode = mode;
+
+    static const char* const kModeNames[] = {"hold", "linear", "cubic"};
+    std::cout << "[OUT] start / 周期送信開始 (" << rate_hz << " Hz, " << kModeNames[static_cast<int>(mode)]
+              << (cpu >= 0 ? ", cpu " + std::to_string(cpu) : std::string()) << ")." << std::endl;
+    running = true;
+    enabled = true;
+    output_thread = std::thread(output_loop);
+}
+
+void stop_output_scheduler() {
+    if (!enabled) {
+        return;
+    }
+    running = false;
+    if (output_thread.joinable()) {
+        output_thread.join();
+    }
+    enabled = false;
+
+    print_stats();
+    std::cout << "[OUT] stopped / 終了しました." << std::endl;
+}
+
+void output_scheduler_set_change_suppression(const SuppressionConfig& config) {
+    suppression = config;
+}
+
+bool output_scheduler_enabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void output_scheduler_set(const double time, const float* angles, const size_t n) {
+    Setpoints sp{};
+    sp.count = (n < kMaxJoints) ? n : kMaxJoints;
+    std::memcpy(sp.angles.data(), angles, sizeof(float) * sp.count);
+    latest_setpoints.Push(time, sp);
+}
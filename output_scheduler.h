@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+#include "setpoint_interpolator.h"
+#include "setpoint_suppressor.h"
+
+// ODrive への位置指令を一定周期で送り出すスケジューラ．
+// UDJ1 の受信タイミングに合わせて送る代わりに，最新の指令値を保持しておき，
+// clock_nanosleep(TIMER_ABSTIME) で刻む周期ごとに send_positions() で送る．
+// 各周期の起床遅れと周期超過 (overrun) を記録し，停止時にヒストグラムを表示する．
+// RUN の間だけ送信し，RUN に入ってから受け取った指令値が無いうちは何も送らない．
+// 指令値の間は mode に従って補間し (setpoint_interpolator.h)，送信周期ごとに滑らかな目標値を作る．
+
+// 指令値が届かないときに外挿を続ける上限 [sec]．これを越えたら最後の指令値で止める．
+constexpr double MAX_EXTRAPOLATION_SEC = 0.02;
+
+// 前回送った値からの変化が小さい関節を送らないようにする (setpoint_suppressor.h)．
+// start_output_scheduler() より前に呼ぶこと．
+void output_scheduler_set_change_suppression(const SuppressionConfig& config);
+
+// rate_hz 周期の送信スレッドを SCHED_FIFO (priority) で起動する．cpu >= 0 ならそのコアに固定する．
+void start_output_scheduler(double rate_hz, int priority, int cpu, InterpMode mode = InterpMode::kHold);
+void stop_output_scheduler();
+
+// スケジューラが動いていれば true．false の間は呼び出し側が直接送信する．
+bool output_scheduler_enabled();
+
+// 最新の指令値を差し替える．angles[i] は node_id = i + 1 宛て．
+// 書き込みは 1 スレッド (UDJ1) からだけ行うこと．
+void output_scheduler_set(double time, const float* angles, size_t n);
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// ポテンショメータ全チャンネル分の平滑化フィルタ (median-of-N の後に EMA)．
+//
+// 履歴は history_[行][チャンネル] の structure-of-arrays で持ち，メディアンと EMA は
+// 全チャンネルをまとめて同じループで計算する (コンパイラがベクトル化しやすい形)．
+// Pico ごとにフレームが届くので，書き込み位置は Pico ごとに別に進める．
+// メディアンは値の並び順によらないので，行がそろっていなくても問題ない．
+//
+// EMA は新しい値が届いたチャンネルだけ進める (届いていないチャンネルは重み 0)．
+// メモリ確保は起きない．1 スレッド (CAN 受信スレッド) からだけ使うこと．
+template<size_t Groups, size_t ChannelsPerGroup, size_t MedianLength = 5>
+class PotFilter final {
+public:
+    static constexpr size_t kChannels = Groups * ChannelsPerGroup;
+
+    static_assert(MedianLength == 1 || MedianLength == 3 || MedianLength == 5,
+                  "median length must be 1, 3 or 5");
+
+    // alpha は EMA の重み (0 < alpha <= 1)．1 ならメディアンだけ．
+    explicit PotFilter(const float alpha) : alpha_(alpha) {}
+
+    // group の新しい値 (ChannelsPerGroup 個) を入れ，全チャンネルのフィルタ出力を更新する．
+    void Update(const size_t group, const uint16_t* values) {
+        const size_t base = group * ChannelsPerGroup;
+
+        // 初回は履歴を同じ値で埋めて，立ち上がりでメディアンが 0 に引っ張られないようにする.
+        const size_t rows = primed_[group] ? 1 : MedianLength;
+        for (size_t r = 0; r < rows; ++r) {
+            const size_t row = primed_[group] ? next_row_[group] : r;
+            for (size_t c = 0; c < ChannelsPerGroup; ++c) {
+                history_[row][base + c] = static_cast<float>(values[c]);
+            }
+        }
+        next_row_[group] = (next_row_[group] + 1) % MedianLength;
+
+        std::array<float, kChannels> weight{};
+        for (size_t c = 0; c < ChannelsPerGroup; ++c) {
+            weight[base + c] = primed_[group] ? alpha_ : 1.0f;
+        }
+        primed_[group] = true;
+
+        Median(median_);
+        for (size_t ch = 0; ch < kChannels; ++ch) {
+            output_[ch] += weight[ch] * (median_[ch] - output_[ch]);
+        }
+    }
+
+    // フィルタ出力 (ADC 値と同じ単位)．
+    const std::array<float, kChannels>& Output() const { return output_; }
+
+    float Output(const size_t group, const size_t channel) const {
+        return output_[group * ChannelsPerGroup + channel];
+    }
+
+private:
+    static void Sort2(float& a, float& b) {
+        const float lo = std::min(a, b);
+        b = std::max(a, b);
+        a = lo;
+    }
+
+    // 各チャンネルの履歴のメディアンを out に書く．
+    // チャンネルについてのループの中は min/max だけなので，ベクトル化される.
+    void Median(std::array<float, kChannels>& out) const {
+        if constexpr (MedianLength == 1) {
+            out = history_[0];
+        } else if constexpr (MedianLength == 3) {
+            for (size_t ch = 0; ch < kChannels; ++ch) {
+                float a = history_[0][ch], b = history_[1][ch], c = history_[2][ch];
+                Sort2(a, b);
+                out[ch] = std::max(a, std::min(b, c));
+            }
+        } else {
+            // 5 個のメディアン (比較 7 回のネットワーク)．
+            for (size_t ch = 0; ch < kChannels; ++ch) {
+                float a = history_[0][ch], b = history_[1][ch], c = history_[2][ch];
+                float d = history_[3][ch], e = history_[4][ch];
+                Sort2(a, b);
+                Sort2(d, e);
+                Sort2(a, d);  // a は最小なので捨てられる.
+                Sort2(b, e);  // e は最大なので捨てられる.
+                Sort2(b, c);
+                Sort2(c, d);
+                Sort2(b, c);
+                out[ch] = c;
+            }
+        }
+    }
+
+    float alpha_;
+    std::array<std::array<float, kChannels>, MedianLength> history_{};
+    std::array<size_t, Groups> next_row_{};
+    std::array<bool, Groups> primed_{};
+    std::array<float, kChannels> median_{};
+    std::array<float, kChannels> output_{};
+};
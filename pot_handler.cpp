@@ -1,90 +1,169 @@
 #include "pot_handler.h"
 #include <netinet/in.h>
-#include <sys/ioctl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <linux/can.h>
-#include <linux/can/raw.h>
-#include <net/if.h>
+#include <sys/eventfd.h>
 
 #include <chrono>
+#include <cmath>
+#include <limits>
 #include <cstring>
 #include <iostream>
+#include <string>
 #include <thread>
+#include <algorithm>
 #include <array>
-#include <vector>
+#include <atomic>
 
+#include "can_rx.h"
+#include "can_topology.h"
 #include "global_variable.h"
+#include "pot_filter.h"
+#include "time_utils.h"
 
 // ===== UDP =====
 constexpr int POT_RX_PORT = 50010;
 constexpr int POT_TX_PORT = 50011;
 
 // ===== CAN =====
-constexpr uint32_t CAN_RESP_BASE   = 0x301;   // 0x301 - 0x306
-// constexpr int      NUM_PICO        = 6;
+constexpr uint32_t CAN_RESP_BASE   = ROBOT_PICO_CAN_BASE;   // 0x301 - 0x306
 // constexpr int      ADC_PER_PICO    = 3;
 
+constexpr int POT_POLL_TIMEOUT_MS = 100;
+
 // ===== Packet =====
 static constexpr char POTQ_MAGIC[4] = {'P','O','T','Q'};
 static constexpr char POTR_MAGIC[4] = {'P','O','T','R'};
+static constexpr char POTS_MAGIC[4] = {'P','O','T','S'};  // 購読: "POTS" group req rate_hz(u16, 0 なら変化時)
+static constexpr char POTU_MAGIC[4] = {'P','O','T','U'};  // 購読解除: "POTU" group
+
+constexpr size_t POTR_AGE_OFFSET = 7 + NUM_PICO * ADC_PER_PICO * 3;
+constexpr size_t POTR_SIZE = POTR_AGE_OFFSET + NUM_PICO * 2;
+constexpr uint16_t POTR_AGE_MAX_MS = 0xFFFF;
+
+constexpr float PICO_RATE_GAIN = 0.1f;  // 到着頻度の移動平均の重み.
+
+// ☆ 平滑化フィルタの設定．メディアンの長さ (1, 3, 5) と EMA の重み (1 ならメディアンだけ)．
+constexpr size_t POT_FILTER_MEDIAN_LENGTH = 5;
+constexpr float POT_FILTER_EMA_ALPHA = 0.3f;
+
+// POTQ / POTS の flags.
+constexpr uint8_t POT_FLAG_FILTERED = 1u << 0;
+
+// ===== Subscription =====
+constexpr size_t POT_MAX_SUBSCRIBERS = 8;
+constexpr double POT_MAX_PUSH_RATE_HZ = 1000.0;
+constexpr double POT_LOG_INTERVAL_SEC = 1.0;  // 送信ログを表示する最短間隔.
 
 // ===== Internal Variables =====
 static std::thread pot_thread{};
+static PotValues latest{};
+
+// 全チャンネルの平滑化フィルタ．CAN 受信スレッドだけが触る.
+static PotFilter<NUM_PICO, ADC_PER_PICO, POT_FILTER_MEDIAN_LENGTH> pot_filter(POT_FILTER_EMA_ALPHA);
+
+// Pico ごとの前回の受信時刻と到着頻度．CAN 受信スレッドだけが触る.
+static std::array<bool, NUM_PICO> arrived{};
+static std::array<double, NUM_PICO> last_arrival{};
+static std::array<float, NUM_PICO> arrival_rate{};
+
+// 購読者．UDP を処理するスレッド (pot_loop またはリアクタ) だけが触る.
+struct PotSubscriber {
+    bool active;
+    in_addr addr;
+    uint8_t group_id;
+    uint8_t seq;        // 送るたびに 1 ずつ増やして POTR の req_id 欄に入れる.
+    PotSource source;
+    double period;      // 送信周期 [sec]．0 なら値が変わったときに送る.
+    double next_push;   // 次に送る時刻 (now_time_sec() 基準).
+};
+static std::array<PotSubscriber, POT_MAX_SUBSCRIBERS> subscribers{};
+
+// 値の変化を待つ購読者の数と，変化を UDP 側に知らせる eventfd.
+static std::atomic<int> change_subscribers{0};
+static int change_fd = -1;
+static bool values_changed = false;
+
+// POTR の送信バッファ．使い回す.
+static std::array<uint8_t, POTR_SIZE> potr_packet{};
+
+// 送信ログは POT_LOG_INTERVAL_SEC ごとにまとめて表示する.
+static uint64_t replies_since_log = 0;
+static uint64_t pushes_since_log = 0;
+static double last_log_time = 0.0;
+
+// この時刻 (steady_clock の count) まで受信値を表示する．
+static std::atomic<std::chrono::steady_clock::rep> disp_until{
+    std::chrono::steady_clock::time_point::min().time_since_epoch().count()};
 
 // ======================================================
 
-static int open_can_socket(const char* ifname) {
-    int s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
-    if (s < 0) {
-        std::cerr << "[POT] socket(PF_CAN) failed" << std::endl;
-        return -1;
-    }
+// CAN 受信スレッド (can_rx) 上で呼ばれる．
+// latest は受信スレッドからしか触らないので，ロックは不要．
+static void on_pico_frame(const can_frame& rx, const double rx_time) {
+    const int pico = rx.can_id - CAN_RESP_BASE;  // 0..5
+    const int pair_count = rx.can_dlc / 2;
+    const int limit = (pair_count < ADC_PER_PICO) ? pair_count : ADC_PER_PICO;
 
-    ifreq ifr{};
-    std::strcpy(ifr.ifr_name, ifname);
-    if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
-        std::cerr << "[POT] ioctl(SIOCGIFINDEX) failed" << std::endl;
-        close(s);
-        return -1;
+    const bool should_print = std::chrono::steady_clock::now().time_since_epoch().count() < disp_until;
+    if (should_print) {
+        std::cout << "[POT] can " << std::hex << rx.can_id << std::dec << ":";
+    }
+    bool changed = false;
+    for (int i = 0; i < limit; ++i) {
+        uint16_t adc = rx.data[i * 2] | (rx.data[i * 2 + 1] << 8);
+        changed = changed || (latest[pico][i] != adc);
+        latest[pico][i] = adc;
+        if (should_print) {
+            std::cout << " ch" << (pico * ADC_PER_PICO + i)
+                      << "=" << adc;
+        }
     }
 
-    sockaddr_can addr{};
-    addr.can_family  = AF_CAN;
-    addr.can_ifindex = ifr.ifr_ifindex;
+    if (should_print) { std::cout << std::endl; }
 
-    if (bind(s, (sockaddr*)&addr, sizeof(addr)) < 0) {
-        std::cerr << "[POT] bind(CAN) failed" << std::endl;
-        close(s);
-        return -1;
+    // 到着頻度を更新する.
+    const double dt = rx_time - last_arrival[pico];
+    if (arrived[pico] && dt > 0.0) {
+        const float inst = static_cast<float>(1.0 / dt);
+        arrival_rate[pico] = (arrival_rate[pico] == 0.0f)
+                           ? inst : arrival_rate[pico] + PICO_RATE_GAIN * (inst - arrival_rate[pico]);
     }
-    return s;
-}
-
-// ======================================================
+    last_arrival[pico] = rx_time;
+    arrived[pico] = true;
 
-static void pot_loop() {
-    // ----- CAN socket -----
-    const int can_sock = open_can_socket("can0");
-    if (can_sock < 0) {
-        return;
+    if (limit == ADC_PER_PICO) {
+        pot_filter.Update(pico, latest[pico].data());
+    }
+    PotFrame frame{latest, {}};
+    for (int p = 0; p < NUM_PICO; ++p) {
+        for (int ch = 0; ch < ADC_PER_PICO; ++ch) {
+            frame.filtered[p][ch] = static_cast<uint16_t>(pot_filter.Output(p, ch) + 0.5f);
+        }
     }
 
-    int flags = fcntl(can_sock, F_GETFL, 0);
-    if (flags < 0 || fcntl(can_sock, F_SETFL, flags | O_NONBLOCK) < 0) {
-        std::cerr << "[POT] fcntl(CAN O_NONBLOCK) failed" << std::endl;
-        close(can_sock);
-        return;
+    // グローバル変数にも保存しておく．
+    g_pot_values.Push(rx_time, frame);
+    g_pico_readings[pico].Push(rx_time, {latest[pico], arrival_rate[pico]});
+
+    // 変化時の購読者がいれば UDP 側を起こす.
+    if (changed && change_fd >= 0 && change_subscribers.load(std::memory_order_relaxed) > 0) {
+        const uint64_t one = 1;
+        write(change_fd, &one, sizeof(one));
     }
+}
 
-    // ----- UDP socket -----
+// ======================================================
+
+static int open_udp_socket() {
     const int udp_sock = socket(AF_INET, SOCK_DGRAM, 0);
     if (udp_sock < 0) {
         std::cerr << "[POT] socket(AF_INET) failed" << std::endl;
-        close(can_sock);
-        return;
+        return -1;
     }
 
     sockaddr_in rx_addr{};
@@ -94,138 +173,298 @@ static void pot_loop() {
     if (bind(udp_sock, (sockaddr*)&rx_addr, sizeof(rx_addr)) < 0) {
         std::cerr << "[POT] bind(UDP) failed" << std::endl;
         close(udp_sock);
-        close(can_sock);
-        return;
+        return -1;
     }
 
     int flags_ = fcntl(udp_sock, F_GETFL, 0);
     if (flags_ < 0 || fcntl(udp_sock, F_SETFL, flags_ | O_NONBLOCK) < 0) {
         std::cerr << "[POT] fcntl(O_NONBLOCK) failed" << std::endl;
         close(udp_sock);
-        close(can_sock);
-        return;
+        return -1;
     }
 
     std::cout << "[POT] listening POTQ on " << POT_RX_PORT << std::endl;
+    return udp_sock;
+}
 
-    uint8_t buf[1500];
-    std::array<std::array<uint16_t, ADC_PER_PICO>, NUM_PICO> latest{};
-    auto disp_until = std::chrono::steady_clock::time_point::min();
-
-    while (!g_thread_safe_store.Get<bool>("fin")) {
-        if (const auto disp = g_thread_safe_store.TryGet<int>("pot")) {
-            if (*disp > 0) {
-                disp_until = std::chrono::steady_clock::now()
-                           + std::chrono::seconds(*disp);
-                g_thread_safe_store.Set<int>("pot", 0);
+// 送信ログを，前回の表示から POT_LOG_INTERVAL_SEC 以上経っていればまとめて表示する.
+static void log_sends(const double now) {
+    if (now - last_log_time < POT_LOG_INTERVAL_SEC) {
+        return;
+    }
+    std::cout << "[POT] sent " << (replies_since_log + pushes_since_log) << " POTR ("
+              << replies_since_log << " replies, " << pushes_since_log << " pushes, "
+              << (NUM_PICO * ADC_PER_PICO) << " samples each)" << std::endl;
+    replies_since_log = 0;
+    pushes_since_log = 0;
+    last_log_time = now;
+}
+
+// 最新のポテンショメータ値で POTR を組み立てて addr に送る.
+static void send_potr(const int udp_sock, const in_addr addr,
+                      const uint8_t group_id, const uint8_t req_id, const PotSource source) {
+    // ===== build POTR =====
+    uint8_t* pkt = potr_packet.data();
+    std::memcpy(&pkt[0], POTR_MAGIC, 4);
+    pkt[4] = group_id;
+    pkt[5] = req_id;
+    pkt[6] = NUM_PICO * ADC_PER_PICO;
+
+    const PotValues values = pot_latest_values(source);
+
+    size_t off = 7;
+    for (int pico = 0; pico < NUM_PICO; ++pico) {
+        for (int ch = 0; ch < ADC_PER_PICO; ++ch) {
+            const uint8_t out_ch = pico * ADC_PER_PICO + ch;
+            const uint16_t adc = values[pico][ch];
+            pkt[off++] = out_ch;
+            pkt[off++] = adc & 0xFF;
+            pkt[off++] = (adc >> 8) & 0xFF;
+        }
+    }
+
+    // Pico ごとの経過時間 [ms]．
+    for (int pico = 0; pico < NUM_PICO; ++pico) {
+        const double age_ms = pot_age_sec(pico) * 1000.0;
+        const uint16_t age = (age_ms >= POTR_AGE_MAX_MS) ? POTR_AGE_MAX_MS : static_cast<uint16_t>(age_ms);
+        pkt[POTR_AGE_OFFSET + pico * 2] = age & 0xFF;
+        pkt[POTR_AGE_OFFSET + pico * 2 + 1] = (age >> 8) & 0xFF;
+    }
+
+    sockaddr_in tx{};
+    tx.sin_family = AF_INET;
+    tx.sin_port   = htons(POT_TX_PORT);
+    tx.sin_addr   = addr;
+
+    sendto(udp_sock, pkt, POTR_SIZE, MSG_DONTWAIT,
+           (sockaddr*)&tx, sizeof(tx));
+}
+
+static PotSource source_of(const uint8_t flags) {
+    return (flags & POT_FLAG_FILTERED) ? PotSource::kFiltered : PotSource::kRaw;
+}
+
+static PotSubscriber* find_subscriber(const in_addr addr, const uint8_t group_id) {
+    for (auto& sub : subscribers) {
+        if (sub.active && sub.addr.s_addr == addr.s_addr && sub.group_id == group_id) {
+            return &sub;
+        }
+    }
+    return nullptr;
+}
+
+static void update_change_subscribers() {
+    const auto count = std::count_if(subscribers.begin(), subscribers.end(),
+        [](const PotSubscriber& sub) { return sub.active && sub.period == 0.0; });
+    change_subscribers = static_cast<int>(count);
+}
+
+// POTS: 購読を登録する (同じ送信元・グループなら周期を更新する).
+static void subscribe(const in_addr addr, const uint8_t group_id, const uint8_t req_id,
+                      const uint16_t rate_hz, const PotSource source) {
+    PotSubscriber* sub = find_subscriber(addr, group_id);
+    if (sub == nullptr) {
+        const auto free_slot = std::find_if(subscribers.begin(), subscribers.end(),
+            [](const PotSubscriber& s) { return !s.active; });
+        if (free_slot == subscribers.end()) {
+            std::cerr << "[POT] too many subscribers, ignored" << std::endl;
+            return;
+        }
+        sub = &*free_slot;
+    }
+
+    const double rate = std::min(static_cast<double>(rate_hz), POT_MAX_PUSH_RATE_HZ);
+    *sub = PotSubscriber{true, addr, group_id, req_id, source, (rate > 0.0) ? 1.0 / rate : 0.0, now_time_sec()};
+    update_change_subscribers();
+
+    // 変化時の購読でも，まず現在値を 1 回送る.
+    values_changed = values_changed || (sub->period == 0.0);
+    std::cout << "[POT] subscribe group " << static_cast<int>(group_id)
+              << (rate_hz > 0 ? " at " + std::to_string(static_cast<int>(rate)) + " Hz" : std::string(" on change"))
+              << std::endl;
+}
+
+// POTU: 購読を解除する.
+static void unsubscribe(const in_addr addr, const uint8_t group_id) {
+    PotSubscriber* sub = find_subscriber(addr, group_id);
+    if (sub != nullptr) {
+        sub->active = false;
+        update_change_subscribers();
+        std::cout << "[POT] unsubscribe group " << static_cast<int>(group_id) << std::endl;
+    }
+}
+
+static void pot_loop() {
+    // ----- UDP socket -----
+    const int udp_sock = open_udp_socket();
+    if (udp_sock < 0) {
+        return;
+    }
+
+    while (!g_thread_safe_store.Get(KEY_FIN)) {
+        // POTQ / POTS が届くか，値が変わるか，次の周期送信まで待つ．fin を確認するため時間制限を付ける.
+        const int timeout_ms = static_cast<int>(
+            std::min(pot_next_push_sec() * 1000.0, static_cast<double>(POT_POLL_TIMEOUT_MS)));
+        pollfd pfds[2] = {{udp_sock, POLLIN, 0}, {change_fd, POLLIN, 0}};
+        if (poll(pfds, 2, std::max(timeout_ms, 0)) > 0) {
+            if (pfds[0].revents & POLLIN) {
+                pot_on_readable(udp_sock);
+            }
+            if (pfds[1].revents & POLLIN) {
+                pot_on_change();
             }
         }
+        pot_on_tick(udp_sock);
+    }
 
+    close(udp_sock);
+}
+
+int pot_open_socket() {
+    return open_udp_socket();
+}
+
+void pot_on_readable(const int udp_sock) {
+    uint8_t buf[1500];
+    for (;;) {
         sockaddr_in src{};
         socklen_t slen = sizeof(src);
-        bool has_request = false;
-        uint8_t group_id = 0;
-        uint8_t req_id = 0;
-
         const ssize_t len = recvfrom(udp_sock, buf, sizeof(buf), 0,
                                (sockaddr*)&src, &slen);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "[POT] recvfrom() failed" << std::endl;
+            }
+            return;
+        }
         if (len >= 6 && std::memcmp(buf, POTQ_MAGIC, 4) == 0) {
-            group_id = buf[4];
-            req_id = buf[5];
-            has_request = true;
-        } else if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-            std::cerr << "[POT] recvfrom() failed" << std::endl;
-            break;
+            send_potr(udp_sock, src.sin_addr, buf[4], buf[5], source_of(len > 6 ? buf[6] : 0));
+            ++replies_since_log;
+            log_sends(now_time_sec());
+        } else if (len >= 8 && std::memcmp(buf, POTS_MAGIC, 4) == 0) {
+            subscribe(src.sin_addr, buf[4], buf[5], static_cast<uint16_t>(buf[6] | (buf[7] << 8)),
+                      source_of(len > 8 ? buf[8] : 0));
+        } else if (len >= 5 && std::memcmp(buf, POTU_MAGIC, 4) == 0) {
+            unsubscribe(src.sin_addr, buf[4]);
         }
+    }
+}
 
-        for (;;) {
-            can_frame rx{};
-            ssize_t r = read(can_sock, &rx, sizeof(rx));
-            if (r < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    break;
-                }
-                std::cerr << "[POT] read(CAN) failed" << std::endl;
-                break;
-            }
-            if (r == 0) {
-                break;
-            }
+PotValues pot_latest_values(const PotSource source) {
+    const PotFrame frame = g_pot_values.Latest().value_or(PotSample{}).value;
+    return (source == PotSource::kFiltered) ? frame.filtered : frame.raw;
+}
 
-            if (rx.can_id < CAN_RESP_BASE ||
-                rx.can_id >= CAN_RESP_BASE + NUM_PICO) {
-                continue;
-            }
+double pot_age_sec(const int pico) {
+    const auto reading = g_pico_readings[pico].Latest();
+    if (!reading) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return std::max(now_time_sec() - reading->time, 0.0);
+}
 
-            const int pico = rx.can_id - CAN_RESP_BASE;  // 0..5
-            const int pair_count = rx.can_dlc / 2;
-            const int limit = (pair_count < ADC_PER_PICO) ? pair_count : ADC_PER_PICO;
+float pot_frame_rate_hz(const int pico) {
+    const auto reading = g_pico_readings[pico].Latest();
+    return reading ? reading->value.rate_hz : 0.0f;
+}
 
-            const bool should_print = std::chrono::steady_clock::now() < disp_until;
-            if (should_print) {
-                std::cout << "[POT] can " << std::hex << rx.can_id << std::dec << ":";
-            }
-            for (int i = 0; i < limit; ++i) {
-                uint16_t adc = rx.data[i * 2] | (rx.data[i * 2 + 1] << 8);
-                latest[pico][i] = adc;
-                if (should_print) {
-                    std::cout << " ch" << (pico * ADC_PER_PICO + i)
-                              << "=" << adc;
-                }
-            }
+bool pot_is_fresh(const int pico, const double max_age) {
+    return pot_age_sec(pico) <= max_age;
+}
+
+void pot_report() {
+    for (int pico = 0; pico < NUM_PICO; ++pico) {
+        std::cout << "[POT] pico" << pico << " (0x" << std::hex << (CAN_RESP_BASE + pico) << std::dec << "):";
+        const double age = pot_age_sec(pico);
+        if (std::isinf(age)) {
+            std::cout << " no frames" << std::endl;
+        } else {
+            std::cout << " rate=" << pot_frame_rate_hz(pico) << " Hz age=" << age * 1000.0 << " ms"
+                      << (pot_is_fresh(pico) ? "" : " (stale)") << std::endl;
+        }
+    }
+}
 
-            if (should_print) { std::cout << std::endl; }
+int pot_change_fd() {
+    return change_fd;
+}
 
-            // グローバル変数にも保存しておく．
-            g_pot_values.PushBack(latest);
+void pot_on_change() {
+    uint64_t count = 0;
+    read(change_fd, &count, sizeof(count));
+    values_changed = true;
+}
+
+double pot_next_push_sec() {
+    if (values_changed) {
+        return 0.0;
+    }
+    const double now = now_time_sec();
+    double next = 1e9;
+    for (const auto& sub : subscribers) {
+        if (sub.active && sub.period > 0.0) {
+            next = std::min(next, sub.next_push - now);
         }
+    }
+    return std::max(next, 0.0);
+}
 
-        if (!has_request) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+void pot_on_tick(const int udp_sock) {
+    const double now = now_time_sec();
+    uint64_t pushed = 0;
+    for (auto& sub : subscribers) {
+        if (!sub.active) {
             continue;
         }
-
-        // ===== build POTR =====
-        std::vector<uint8_t> pkt;
-        pkt.resize(7 + NUM_PICO * ADC_PER_PICO * 3);
-
-        std::memcpy(&pkt[0], POTR_MAGIC, 4);
-        pkt[4] = group_id;
-        pkt[5] = req_id;
-        pkt[6] = NUM_PICO * ADC_PER_PICO;
-
-        size_t off = 7;
-        for (int pico = 0; pico < NUM_PICO; ++pico) {
-            for (int ch = 0; ch < ADC_PER_PICO; ++ch) {
-                const uint8_t out_ch = pico * ADC_PER_PICO + ch;
-                const uint16_t adc = latest[pico][ch];
-                pkt[off++] = out_ch;
-                pkt[off++] = adc & 0xFF;
-                pkt[off++] = (adc >> 8) & 0xFF;
+        const bool due = (sub.period > 0.0) ? (now >= sub.next_push) : values_changed;
+        if (!due) {
+            continue;
+        }
+        send_potr(udp_sock, sub.addr, sub.group_id, sub.seq++, sub.source);
+        ++pushed;
+        if (sub.period > 0.0) {
+            // 遅れた分はまとめて飛ばす (溜めて連射しない).
+            sub.next_push += sub.period;
+            if (sub.next_push < now) {
+                sub.next_push = now + sub.period;
             }
         }
+    }
+    values_changed = false;
 
-        sockaddr_in tx{};
-        tx.sin_family = AF_INET;
-        tx.sin_port   = htons(POT_TX_PORT);
-        tx.sin_addr   = src.sin_addr;
+    if (pushed > 0) {
+        pushes_since_log += pushed;
+        log_sends(now);
+    }
+}
 
-        sendto(udp_sock, pkt.data(), pkt.size(), 0,
-               (sockaddr*)&tx, sizeof(tx));
+void pot_register_handlers() {
+    change_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (change_fd < 0) {
+        std::cerr << "[POT] eventfd() failed" << std::endl;
+    }
 
-        std::cout << "[POT] reply " << (NUM_PICO * ADC_PER_PICO)
-                  << " samples" << std::endl;
+    // Pico の応答 (0x301 - 0x306) は Pico のインタフェースの CAN 受信スレッドから受け取る.
+    for (int pico = 0; pico < NUM_PICO; ++pico) {
+        can_rx_register(CAN_RESP_BASE + pico, CAN_SFF_MASK, on_pico_frame, static_cast<int>(can_pico_bus()));
     }
 
-    close(udp_sock);
-    close(can_sock);
+    // "pot" に秒数が書かれたら，その間だけ受信値を表示する.
+    g_thread_safe_store.Subscribe(KEY_POT, [](const int& sec) {
+        if (sec > 0) {
+            disp_until = (std::chrono::steady_clock::now()
+                          + std::chrono::seconds(sec)).time_since_epoch().count();
+        }
+    });
 }
 
 // ======================================================
 
 void start_pot_thread()
 {
-    // ポテンショメータの読み取りスレッドを起動.
+    pot_register_handlers();
+
+    // ポテンショメータの POTQ 応答スレッドを起動.
     pot_thread = std::thread(pot_loop);
 }
 
@@ -233,4 +472,13 @@ void stop_pot_thread() {
     if (pot_thread.joinable()) {
         pot_thread.join();
     }
+    pot_close();
+    pot_report();
+}
+
+void pot_close() {
+    if (change_fd >= 0) {
+        close(change_fd);
+        change_fd = -1;
+    }
 }
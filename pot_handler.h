@@ -2,10 +2,72 @@
 
 #include <cstdint>
 
+#include "global_variable.h"
+
 // Raspberry Pi Pico (×6) の値を CAN 経由で取得する．
 // Raspberry Pi Pico 1台あたり 3ch の ADC 値を持つ．
 // つまり，合計 18ch の ポテンショメータ値を取得する．
 // ポテンショメータの値は 12bit ADC 値 (0..4095) である．
+//
+// UDP (50010 番で受信，応答は送信元の 50011 番へ POTR):
+//   POTQ group req [flags]  : 最新値を POTR で 1 回返す．
+//                             flags (省略可) の bit0 が立っていれば平滑化した値を返す．省略時は生の値．
+//                             POTR は "POTR" group req count (ch lo hi)×count の後ろに，
+//                             Pico ごとの最終受信からの経過時間 age_ms (u16 LE)×NUM_PICO が続く．
+//                             age_ms は 0xFFFF で飽和する (一度も受信していない場合も 0xFFFF)．
+//   POTS group req rate_hz [flags] : 購読．rate_hz (u16, LE) の周期で POTR を送り続ける．flags は POTQ と同じ．
+//                             rate_hz = 0 なら，Pico の値が変わるたびに送る．
+//                             POTR の req 欄は req から始めて送るたびに 1 ずつ増える．
+//                             同じ送信元・group で送り直すと周期を変更できる．
+//   POTU group              : 購読を解除する．
 
 void start_pot_thread();
 void stop_pot_thread();
+
+// ☆ これより古い Pico の値は使わない (キャリブレーションなど)．Pico の送信周期に合わせて調整すること．
+constexpr double POT_MAX_AGE_SEC = 0.2;
+
+// Pico (0..NUM_PICO-1) の最終受信からの経過秒数．一度も受信していなければ無限大．
+double pot_age_sec(int pico);
+
+// Pico のフレームの到着頻度 [Hz]．2 フレーム受信するまでは 0．
+float pot_frame_rate_hz(int pico);
+
+// Pico の値が max_age 秒以内に更新されていれば true．
+bool pot_is_fresh(int pico, double max_age = POT_MAX_AGE_SEC);
+
+// ポテンショメータ値の種類．
+enum class PotSource {
+    kRaw,       // ADC の生の値．
+    kFiltered,  // median + EMA で平滑化した値 (pot_filter.h)．
+};
+
+// 最新のポテンショメータ値．まだ受信していなければすべて 0．
+PotValues pot_latest_values(PotSource source);
+
+// Pico ごとの到着頻度と経過時間を表示する．
+void pot_report();
+
+// ===== リアクタモード用 (reactor.h) =====
+
+// CAN 受信ハンドラと "pot" の購読を登録する．start_pot_thread() も内部で呼ぶ．
+// can_rx の受信開始より前に呼ぶこと．
+void pot_register_handlers();
+
+// ノンブロッキングの POTQ 受信ソケットを開く．失敗時は -1．
+int pot_open_socket();
+
+// sock に届いている POTQ / POTS / POTU をすべて処理する．
+void pot_on_readable(int sock);
+
+// 値が変わったときに読めるようになる eventfd (変化時の購読者がいるときだけ)．
+// 読めるようになったら pot_on_change() を呼ぶ．
+int pot_change_fd();
+void pot_on_change();
+
+// 次に購読者へ送るべき時刻までの秒数．その時刻になったら pot_on_tick() を呼ぶ．
+double pot_next_push_sec();
+void pot_on_tick(int sock);
+
+// pot_register_handlers() で開いたものを閉じる．
+void pot_close();
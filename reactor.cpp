@@ -0,0 +1,196 @@
+#include "reactor.h"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "can_rx.h"
+#include "ctrl_manager.h"
+#include "global_variable.h"
+#include "pot_handler.h"
+#include "stdin_writer.h"
+#include "thread_priority.h"
+#include "udj1_handler.h"
+
+namespace {
+constexpr int kMaxEvents = 16;
+
+// epoll に登録する fd の種類．epoll_event.data.u32 に入れる.
+enum Source : uint32_t {
+    kUdj1,
+    kPot,
+    kPotChange,
+    kStdin,
+    kTimer,
+    kWake,
+    kCanBase,  // kCanBase + i がインタフェース i の CAN 受信ソケット．最後に置くこと.
+};
+
+bool add_fd(const int epfd, const int fd, const uint32_t source) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u32 = source;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        std::cerr << "[REACTOR] epoll_ctl(" << source << ") failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// timerfd を，sec 秒後に 1 回だけ鳴るように設定する.
+void arm_timer(const int timer_fd, const double sec) {
+    const double clamped = (sec > 1e-6) ? sec : 1e-6;
+    itimerspec spec{};
+    spec.it_value.tv_sec = static_cast<time_t>(clamped);
+    spec.it_value.tv_nsec = static_cast<long>((clamped - std::floor(clamped)) * 1e9);
+    timerfd_settime(timer_fd, 0, &spec, nullptr);
+}
+
+void drain_counter(const int fd) {
+    uint64_t count = 0;
+    read(fd, &count, sizeof(count));
+}
+
+// 標準入力から読めるだけ読み，行ごとに StdinWriter へ渡す．入力が閉じたら false．
+bool read_stdin(StdinWriter& writer, std::string& pending) {
+    char buf[256];
+    for (;;) {
+        const ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+        if (n == 0) {
+            return false;
+        }
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        pending.append(buf, static_cast<size_t>(n));
+
+        size_t pos = 0;
+        while ((pos = pending.find('\n')) != std::string::npos) {
+            writer.HandleLine(pending.substr(0, pos));
+            pending.erase(0, pos + 1);
+        }
+    }
+}
+}  // namespace
+
+void run_reactor() {
+    std::cout << "[REACTOR] start / リアクタモードで起動します." << std::endl;
+	set_fifo_priority(80);
+
+    // CAN 受信ハンドラを出そろえてからソケットを開く.
+    pot_register_handlers();
+
+    const int epfd = epoll_create1(EPOLL_CLOEXEC);
+    const int udj1_sock = udj1_open_socket();
+    const int pot_sock = pot_open_socket();
+    const std::vector<int> can_socks = can_rx_open();
+    const int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    const int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (epfd < 0 || timer_fd < 0 || wake_fd < 0) {
+        std::cerr << "[REACTOR] epoll/timerfd/eventfd setup failed" << std::endl;
+        return;
+    }
+
+    // 開けなかったソケットは監視しない (スレッドモードでも該当モジュールだけが止まる).
+    if (udj1_sock >= 0) { add_fd(epfd, udj1_sock, kUdj1); }
+    if (pot_sock >= 0) { add_fd(epfd, pot_sock, kPot); }
+    if (pot_change_fd() >= 0) { add_fd(epfd, pot_change_fd(), kPotChange); }
+    for (size_t bus = 0; bus < can_socks.size(); ++bus) {
+        if (can_socks[bus] >= 0) { add_fd(epfd, can_socks[bus], kCanBase + static_cast<uint32_t>(bus)); }
+    }
+    add_fd(epfd, timer_fd, kTimer);
+    add_fd(epfd, wake_fd, kWake);
+
+    const int stdin_flags = fcntl(STDIN_FILENO, F_GETFL, 0);
+    fcntl(STDIN_FILENO, F_SETFL, stdin_flags | O_NONBLOCK);
+    add_fd(epfd, STDIN_FILENO, kStdin);
+
+    // 他のスレッドが fin / cmd / 状態を書いたときに epoll_wait() から起こす.
+    // 状態は UDJ1 が RUN の出入りを (データグラムを待たずに) 処理するため.
+    const auto wake = [wake_fd](const auto&) {
+        const uint64_t one = 1;
+        write(wake_fd, &one, sizeof(one));
+    };
+    const size_t fin_sub = g_thread_safe_store.Subscribe(KEY_FIN, wake);
+    const size_t cmd_sub = g_thread_safe_store.Subscribe(KEY_CMD, wake);
+    const size_t state_sub = g_thread_safe_store.Subscribe(KEY_SYSTEM_STATE, wake);
+
+    StdinWriter writer;
+    std::string stdin_pending;
+    bool stdin_open = true;
+    epoll_event events[kMaxEvents];
+
+    std::cout << "[GW] All handlers registered. / 全てのハンドラを登録しました." << std::endl;
+
+    while (stdin_open && !g_thread_safe_store.Get(KEY_FIN)) {
+        ctrl_tick();
+        if (pot_sock >= 0) {
+            pot_on_tick(pot_sock);
+        }
+        arm_timer(timer_fd, std::min(ctrl_next_tick_sec(), pot_next_push_sec()));
+
+        const int n = epoll_wait(epfd, events, kMaxEvents, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "[REACTOR] epoll_wait() failed" << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            switch (events[i].data.u32) {
+            case kUdj1:
+                udj1_on_readable(udj1_sock);
+                break;
+            case kPot:
+                pot_on_readable(pot_sock);
+                break;
+            case kPotChange:
+                pot_on_change();
+                break;
+            case kStdin:
+                stdin_open = read_stdin(writer, stdin_pending);
+                break;
+            case kTimer:
+                drain_counter(timer_fd);
+                break;
+            case kWake:
+                drain_counter(wake_fd);
+                udj1_on_state_change();
+                break;
+            default:
+                can_rx_on_readable(events[i].data.u32 - kCanBase);
+                break;
+            }
+        }
+    }
+
+    g_thread_safe_store.Unsubscribe(fin_sub);
+    g_thread_safe_store.Unsubscribe(cmd_sub);
+    g_thread_safe_store.Unsubscribe(state_sub);
+    fcntl(STDIN_FILENO, F_SETFL, stdin_flags);
+
+    can_rx_close();
+    if (pot_sock >= 0) { close(pot_sock); }
+    pot_close();
+    pot_report();
+    if (udj1_sock >= 0) { udj1_close_socket(udj1_sock); }
+    close(wake_fd);
+    close(timer_fd);
+    close(epfd);
+
+    udj1_report();
+    std::cout << "[REACTOR] stopped / 終了しました." << std::endl;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// epoll によるシングルスレッドのイベントループ (リアクタモード)．
+// UDJ1 / POTQ の UDP ソケット，CAN 受信ソケット (インタフェースごと)，標準入力，timerfd，終了通知とポテンショメータ値の変化通知の eventfd を
+// 呼び出したスレッド 1 本で監視し，各モジュールのハンドラを呼び出す．
+// スレッドモード (モジュールごとにスレッドを起動する) の代わりに main() から呼ぶ．
+// ログの書き込みスレッドはどちらのモードでも別に起動しておくこと．
+// fin が立つか，標準入力が閉じるまで戻らない．
+void run_reactor();
@@ -0,0 +1,129 @@
+#pragma once
+
+// ロボットの構成 (関節・ODrive・ポテンショメータ) をまとめた表．
+// 関節の数や割り当てを変えるときは ROBOT_JOINTS だけを書き換えること．
+// 各モジュールの配列の大きさ，ループの回数，UDJ1 パケットの関節数はここから決まる．
+// 関節 i の ODrive の node_id は i + 1 (robot_node_id())．表には持たない．
+// どの CAN インタフェースにつながっているかは起動オプション --can-bus で決める (can_topology.h)．
+// 表の矛盾 (範囲外・重複した Pico チャンネルなど) は static_assert でビルド時に検出する．
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+// Pico の台数と，1 台あたりの ADC チャンネル数 (picoのピン 26->27->28 の順)．
+constexpr int ROBOT_PICO_COUNT = 6;
+constexpr int ROBOT_ADC_PER_PICO = 3;
+
+// Pico i の応答の CAN ID は ROBOT_PICO_CAN_BASE + i．
+constexpr uint32_t ROBOT_PICO_CAN_BASE = 0x301;
+
+constexpr int8_t ROBOT_NO_LEG = -1;
+
+struct JointSpec {
+    int8_t leg;           // 所属する脚 (0 始まり)．胴体の関節は ROBOT_NO_LEG で，ゼロ点合わせしない.
+    uint8_t pot_pico;     // ポテンショメータがつながっている Pico．
+    uint8_t pot_channel;  // その Pico の ADC チャンネル．
+    int pot_zero;         // ☆ ゼロ点でのポテンショメータ値．
+    float direction;      // ☆ ゼロ点合わせでポテンショメータ値を増やす回転方向 (+1 / -1)．
+    float tolerance;      // ☆ ゼロ点とみなす誤差 (ポテンショメータ値の差分)．
+};
+
+// 左前脚から反時計周りに割り当てる (行 i が node_id = i + 1)．後ろの4関節は胴体用．
+// ☆ pot_zero / direction はポテンショメータの物理的な取り付けに依存するので，必要に応じて調整すること．
+//    direction の正負を変更すると，キャリブレーション時の回転方向が変わる．
+inline constexpr std::array<JointSpec, 16> ROBOT_JOINTS{{
+    // leg pico ch  pot_zero  dir    tolerance
+    {0, 0, 0, 2076, -1.0f,  50.0f},  // leg1
+    {0, 0, 1, 1962, -1.0f,  50.0f},
+    {0, 0, 2,  726,  1.0f, 200.0f},
+    {1, 1, 0, 1780, -1.0f,  50.0f},  // leg2
+    {1, 1, 1, 1409, -1.0f,  50.0f},
+    {1, 1, 2, 3232, -1.0f, 200.0f},
+    {2, 2, 0, 1891, -1.0f,  50.0f},  // leg3 (2003, 2036, 2250)
+    {2, 2, 1, 1979, -1.0f,  50.0f},
+    {2, 2, 2, 2215,  1.0f, 200.0f},
+    {3, 3, 0, 3223,  1.0f,  50.0f},  // leg4 (2000, 1624, 1665)
+    {3, 3, 1, 1982,  1.0f,  50.0f},
+    {3, 3, 2, 2035, -1.0f, 200.0f},
+    {ROBOT_NO_LEG, 4, 0, 2048, -1.0f, 100.0f},  // body1
+    {ROBOT_NO_LEG, 4, 1, 2048, -1.0f, 100.0f},
+    {ROBOT_NO_LEG, 4, 2, 2048, -1.0f, 100.0f},  // body2
+    {ROBOT_NO_LEG, 5, 0, 2048, -1.0f, 100.0f},
+}};
+
+constexpr size_t ROBOT_JOINT_COUNT = ROBOT_JOINTS.size();
+
+// ===== 表から導く値 =====
+
+constexpr int robot_leg_count() {
+    int count = 0;
+    for (const JointSpec& j : ROBOT_JOINTS) {
+        count = (j.leg + 1 > count) ? j.leg + 1 : count;
+    }
+    return count;
+}
+
+constexpr int ROBOT_LEG_COUNT = robot_leg_count();
+
+// 関節 joint (0 始まり) の ODrive の node_id．位置指令の一括送信 (can_utils.h) と UDJ1 パケットは
+// angles[i] を node_id = i + 1 に送るので，ODrive 側の node_id もこの順に設定すること．
+constexpr int robot_node_id(const size_t joint) {
+    return static_cast<int>(joint) + 1;
+}
+
+// ゼロ点合わせする関節のポテンショメータがつながっている Pico のマスク (bit i が Pico i)．
+constexpr uint32_t ROBOT_ZERO_CALIB_PICO_MASK = [] {
+    uint32_t mask = 0;
+    for (const JointSpec& j : ROBOT_JOINTS) {
+        if (j.leg != ROBOT_NO_LEG) {
+            mask |= 1u << j.pot_pico;
+        }
+    }
+    return mask;
+}();
+
+// f(std::integral_constant<size_t, I>{}) を I = 0 .. ROBOT_JOINT_COUNT - 1 について展開して呼ぶ．
+// ROBOT_JOINTS[I] を定数として使えるので，関節ごとの分岐はコンパイル時に消える．
+template<typename F, size_t... I>
+constexpr void robot_for_each_joint_impl(F&& f, std::index_sequence<I...>) {
+    (f(std::integral_constant<size_t, I>{}), ...);
+}
+
+template<typename F>
+constexpr void robot_for_each_joint(F&& f) {
+    robot_for_each_joint_impl(f, std::make_index_sequence<ROBOT_JOINT_COUNT>{});
+}
+
+// ===== 表の検査 =====
+
+constexpr bool robot_pots_valid() {
+    for (size_t i = 0; i < ROBOT_JOINT_COUNT; ++i) {
+        const JointSpec& a = ROBOT_JOINTS[i];
+        if (a.pot_pico >= ROBOT_PICO_COUNT || a.pot_channel >= ROBOT_ADC_PER_PICO) {
+            return false;
+        }
+        for (size_t k = i + 1; k < ROBOT_JOINT_COUNT; ++k) {
+            if (ROBOT_JOINTS[k].pot_pico == a.pot_pico && ROBOT_JOINTS[k].pot_channel == a.pot_channel) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+constexpr bool robot_joint_params_valid() {
+    for (const JointSpec& j : ROBOT_JOINTS) {
+        if ((j.direction != 1.0f && j.direction != -1.0f) || j.tolerance <= 0.0f || j.leg < ROBOT_NO_LEG) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(ROBOT_JOINT_COUNT <= 32, "setpoint masks are 32 bits (node_id 1..32)");
+static_assert(robot_pots_valid(), "ROBOT_JOINTS: pot channel out of range or used twice");
+static_assert(robot_joint_params_valid(), "ROBOT_JOINTS: invalid direction / tolerance / leg");
+static_assert(ROBOT_PICO_COUNT <= 32, "Pico mask is 32 bits");
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+// 間引いて届く指令値 (UDJ1) から，送信周期ごとの中間値を作る．
+//
+// 受信間隔の推定値だけ遅らせた時刻 (render time) で補間するので，次の指令値が予定通り
+// 届けば常に既知の 2 点の間を補間できる．指令値が遅れて render time が最新の点を越えたら，
+// 最後の区間の速度で max_extrapolation 秒までだけ外挿し，その先は最新値を保持する．
+//
+// メモリ確保は起きない．1 スレッド (周期送信スレッド) からだけ使うこと．
+enum class InterpMode {
+    kHold,    // 補間しない．最新の指令値をそのまま送る (従来通り)．
+    kLinear,  // 線形補間．
+    kCubic,   // 3 次エルミート補間 (接線は前後の差分から求める)．
+};
+
+template<size_t MaxJoints>
+class SetpointInterpolator final {
+public:
+    explicit SetpointInterpolator(const InterpMode mode = InterpMode::kLinear,
+                                  const double max_extrapolation = 0.02)
+        : mode_(mode), max_extrapolation_(max_extrapolation) {}
+
+    void Reset() {
+        size_ = 0;
+        interval_ = 0.0;
+    }
+
+    bool Empty() const { return size_ == 0; }
+
+    // 最後に受け取った指令値の時刻．空なら負の値．
+    double LastTime() const { return (size_ == 0) ? -1.0 : At(0).time; }
+
+    // 推定した受信間隔 [sec]．render time はこの分だけ遅れる．
+    double Interval() const { return interval_; }
+
+    // 時刻 time の指令値を追加する．LastTime() 以前のものは捨てる．
+    void Push(const double time, const float* angles, const size_t n) {
+        if (size_ > 0) {
+            const double dt = time - At(0).time;
+            if (dt <= 0.0) {
+                return;
+            }
+            // 受信間隔を指数移動平均で追う．極端な値は丸める.
+            const double clamped = std::min(std::max(dt, kMinInterval), kMaxInterval);
+            interval_ = (interval_ == 0.0) ? clamped : interval_ + kIntervalGain * (clamped - interval_);
+        }
+
+        head_ = (head_ + 1) % kHistory;
+        size_ = std::min(size_ + 1, kHistory);
+        Sample& s = samples_[head_];
+        s.time = time;
+        s.count = std::min(n, MaxJoints);
+        std::copy(angles, angles + s.count, s.angles.begin());
+    }
+
+    // 時刻 now に送るべき指令値を out に書き，関節数を返す．空なら 0．
+    size_t Evaluate(const double now, float* out) const {
+        if (size_ == 0) {
+            return 0;
+        }
+        const Sample& latest = At(0);
+        const size_t n = latest.count;
+
+        if (mode_ == InterpMode::kHold || size_ == 1) {
+            std::copy(latest.angles.begin(), latest.angles.begin() + n, out);
+            return n;
+        }
+
+        const double t = now - interval_;
+
+        // 遅延: 最後の区間の速度で外挿する (上限つき).
+        if (t >= latest.time) {
+            const Sample& prev = At(1);
+            const double h = latest.time - prev.time;
+            const double ahead = std::min(t - latest.time, max_extrapolation_);
+            for (size_t j = 0; j < n; ++j) {
+                const float v = (latest.angles[j] - prev.angles[j]) / static_cast<float>(h);
+                out[j] = latest.angles[j] + v * static_cast<float>(ahead);
+            }
+            return n;
+        }
+
+        // t を挟む区間 [At(k + 1), At(k)] を探す．履歴より古ければ最古の値を保持する.
+        size_t k = 0;
+        while (k + 1 < size_ && At(k + 1).time > t) {
+            ++k;
+        }
+        if (k + 1 >= size_) {
+            const Sample& oldest = At(size_ - 1);
+            std::copy(oldest.angles.begin(), oldest.angles.begin() + n, out);
+            return n;
+        }
+
+        const Sample& p1 = At(k + 1);
+        const Sample& p2 = At(k);
+        const double h = p2.time - p1.time;
+        const float u = static_cast<float>((t - p1.time) / h);
+
+        if (mode_ == InterpMode::kLinear) {
+            for (size_t j = 0; j < n; ++j) {
+                out[j] = p1.angles[j] + (p2.angles[j] - p1.angles[j]) * u;
+            }
+            return n;
+        }
+
+        // 3 次エルミート．接線は区間の前後の点から中心差分で求め，無い側は片側差分にする.
+        const Sample* p0 = (k + 2 < size_) ? &At(k + 2) : nullptr;
+        const Sample* p3 = (k >= 1) ? &At(k - 1) : nullptr;
+        const float u2 = u * u;
+        const float u3 = u2 * u;
+        const float h00 = 2.0f * u3 - 3.0f * u2 + 1.0f;
+        const float h10 = u3 - 2.0f * u2 + u;
+        const float h01 = -2.0f * u3 + 3.0f * u2;
+        const float h11 = u3 - u2;
+        const auto hf = static_cast<float>(h);
+        for (size_t j = 0; j < n; ++j) {
+            const float chord = (p2.angles[j] - p1.angles[j]) / hf;
+            const float m1 = p0 ? (p2.angles[j] - p0->angles[j]) / static_cast<float>(p2.time - p0->time) : chord;
+            const float m2 = p3 ? (p3->angles[j] - p1.angles[j]) / static_cast<float>(p3->time - p1.time) : chord;
+            out[j] = h00 * p1.angles[j] + h10 * hf * m1 + h01 * p2.angles[j] + h11 * hf * m2;
+        }
+        return n;
+    }
+
+private:
+    static constexpr size_t kHistory = 4;
+    static constexpr double kMinInterval = 0.0005;
+    static constexpr double kMaxInterval = 0.1;
+    static constexpr double kIntervalGain = 0.1;
+
+    struct Sample {
+        double time = 0.0;
+        size_t count = 0;
+        std::array<float, MaxJoints> angles{};
+    };
+
+    // At(0) が最新，At(1) がその 1 つ前．
+    const Sample& At(const size_t age) const {
+        return samples_[(head_ + kHistory - age) % kHistory];
+    }
+
+    InterpMode mode_;
+    double max_extrapolation_;
+
+    std::array<Sample, kHistory> samples_{};
+    size_t head_ = 0;
+    size_t size_ = 0;
+    double interval_ = 0.0;
+};
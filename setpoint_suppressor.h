@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+// 変化の小さい関節の指令値を送らずに，CAN バスの帯域を動いている関節に回すための間引き．
+//
+// 前回送った値から epsilon[i] 以上動いた関節だけを送る．動いていない関節も，
+// 前回の送信から refresh_sec 経ったら送り直す (フレームの取りこぼしで止まったままにならないように)．
+// 送信スケジューラが書き込めずに捨てた関節 (can_tx_take_dropped_setpoints()) は Forget() で送っていないことにするので，
+// 次の周期に送られる．
+//
+// メモリ確保は起きない．1 スレッド (送信するスレッド) からだけ使うこと．
+
+struct SuppressionConfig {
+    bool enabled = false;
+    double refresh_sec = 0.1;
+    std::array<float, 32> epsilon{};  // [rot]．index は node_id - 1．
+};
+
+// "--suppress-eps" の値 ("0.001" なら全関節，"0.001,0.002,..." なら先頭から関節ごと) と
+// "--suppress-refresh" の値 (秒．nullptr なら既定値) から config を作る．解釈できなければ false．
+inline bool parse_suppression_config(const char* eps_text, const char* refresh_text, SuppressionConfig& out) {
+    SuppressionConfig config;
+    size_t count = 0;
+    const char* p = eps_text;
+    while (*p != '\0' && count < config.epsilon.size()) {
+        char* end = nullptr;
+        const float value = std::strtof(p, &end);
+        if (end == p || value < 0.0f) {
+            return false;
+        }
+        config.epsilon[count++] = value;
+        if (*end == '\0') {
+            break;
+        }
+        if (*end != ',') {
+            return false;
+        }
+        p = end + 1;
+    }
+    if (count == 0) {
+        return false;
+    }
+    if (count == 1) {
+        config.epsilon.fill(config.epsilon[0]);
+    }
+
+    if (refresh_text != nullptr) {
+        char* end = nullptr;
+        config.refresh_sec = std::strtod(refresh_text, &end);
+        if (end == refresh_text || *end != '\0' || config.refresh_sec <= 0.0) {
+            return false;
+        }
+    }
+    config.enabled = true;
+    out = config;
+    return true;
+}
+
+template<size_t MaxJoints>
+class SetpointSuppressor final {
+    static_assert(MaxJoints <= 32, "joint mask is 32 bits");
+
+public:
+    void Configure(const SuppressionConfig& config) {
+        enabled_ = config.enabled;
+        refresh_sec_ = config.refresh_sec;
+        for (size_t i = 0; i < MaxJoints; ++i) {
+            epsilon_[i] = config.epsilon[i];
+        }
+        Reset();
+    }
+
+    bool Enabled() const { return enabled_; }
+
+    // 送った値を忘れる．次の Select() は全関節を選ぶ．
+    void Reset() { known_ = 0; }
+
+    // mask の関節 (bit i が node_id = i + 1) の送った値を忘れる．次の Select() はそれらを選ぶ．
+    void Forget(const uint32_t mask) { known_ &= ~mask; }
+
+    // 時刻 now に送るべき関節のマスク (bit i が node_id = i + 1) を返す．
+    uint32_t Select(const double now, const float* angles, const size_t n) const {
+        const uint32_t all = (n >= 32) ? ~0u : ((1u << n) - 1);
+        if (!enabled_) {
+            return all;
+        }
+        uint32_t mask = 0;
+        for (size_t i = 0; i < n && i < MaxJoints; ++i) {
+            const bool known = (known_ >> i) & 1;
+            if (!known || std::fabs(angles[i] - sent_[i]) >= epsilon_[i] || now - sent_time_[i] >= refresh_sec_) {
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+    }
+
+    // n 関節のうち Select() で選んだ mask の関節を送ったことを記録する．
+    void Commit(const double now, const float* angles, const size_t n, uint32_t mask) {
+        const auto selected = static_cast<size_t>(__builtin_popcount(mask));
+        suppressed_ += (n > selected) ? n - selected : 0;
+        selected_ += selected;
+        for (; mask != 0; mask &= mask - 1) {
+            const int i = __builtin_ctz(mask);
+            sent_[i] = angles[i];
+            sent_time_[i] = now;
+            known_ |= 1u << i;
+        }
+    }
+
+    // Select() で送らなかった関節の累計と，送った (送ろうとした) 関節の累計．
+    uint64_t Suppressed() const { return suppressed_; }
+    uint64_t Selected() const { return selected_; }
+
+private:
+    bool enabled_ = false;
+    double refresh_sec_ = 0.1;
+    std::array<float, MaxJoints> epsilon_{};
+    std::array<float, MaxJoints> sent_{};
+    std::array<double, MaxJoints> sent_time_{};
+    uint32_t known_ = 0;  // bit i: sent_[i] が有効.
+
+    uint64_t suppressed_ = 0;
+    uint64_t selected_ = 0;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// 容量固定のロックフリーキュー．書き込み 1 スレッド，読み出し 1 スレッド専用．
+// 領域は最初に確保したものを使い回すので，Push/Pop でメモリ確保は起きない．
+// 満杯のときは TryPush() が false を返す (上書きはしない)．
+template <typename T, size_t Capacity>
+class SpscQueue final {
+    static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+public:
+    SpscQueue() = default;
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // =========================
+    // Producer side
+    // =========================
+    bool TryPush(const T& value) {
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ >= Capacity) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ >= Capacity) {
+                return false;
+            }
+        }
+        buffer_[tail & kMask] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // =========================
+    // Consumer side
+    // =========================
+    bool TryPop(T& out) {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        out = buffer_[head & kMask];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // たまっている分をまとめて取り出し，out(const T&) に渡す．取り出した件数を返す．
+    template <typename Func>
+    size_t PopAll(Func&& out) {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        const uint64_t tail = tail_.load(std::memory_order_acquire);
+        for (uint64_t i = head; i < tail; ++i) {
+            out(buffer_[i & kMask]);
+        }
+        head_.store(tail, std::memory_order_release);
+        return static_cast<size_t>(tail - head);
+    }
+
+    // =========================
+    // Either side
+    // =========================
+    size_t Size() const {
+        const uint64_t tail = tail_.load(std::memory_order_acquire);
+        const uint64_t head = head_.load(std::memory_order_acquire);
+        return static_cast<size_t>(tail - head);
+    }
+
+    bool Empty() const { return Size() == 0; }
+
+    static constexpr size_t GetCapacity() { return Capacity; }
+
+private:
+    static constexpr uint64_t kMask = Capacity - 1;
+
+    alignas(64) std::atomic<uint64_t> head_{0};  // 読み出し側が進める.
+    alignas(64) std::atomic<uint64_t> tail_{0};  // 書き込み側が進める.
+    uint64_t cached_head_ = 0;                   // 書き込み側だけが使う head_ の写し.
+    alignas(64) std::array<T, Capacity> buffer_{};
+};
@@ -67,55 +67,54 @@ bool TryParseDouble(const std::string& s, double& out) {
 
 void StdinWriter::Run() {
     std::string line;
-    while (!g_thread_safe_store.Get<bool>("fin")) {
+    while (!g_thread_safe_store.Get(KEY_FIN)) {
         // 入力を促す．
         // std::cout << "[StdinWriter] > " << std::flush;
 
         if (!std::getline(std::cin, line)) {
             break;
         }
+        HandleLine(line);
+    }
+}
 
-        const auto eq = line.find('=');
-        if (eq == std::string::npos) {
-            continue;
-        }
+void StdinWriter::HandleLine(const std::string& line) {
+    const auto eq = line.find('=');
+    if (eq == std::string::npos) {
+        return;
+    }
 
-        const std::string key = Trim(line.substr(0, eq));
-        const std::string val = Trim(line.substr(eq + 1));
-        if (key.empty()) {
-            continue;
-        }
+    const std::string key = Trim(line.substr(0, eq));
+    const std::string val = Trim(line.substr(eq + 1));
+    if (key.empty()) {
+        return;
+    }
 
-        const auto type = g_thread_safe_store.GetType(key);
-        if (type == ThreadSafeStore::ValueType::kBool) {
-            bool parsed = false;
-            if (TryParseBool(val, parsed)) {
-                std::cout << "[StdinWriter] Set Bool " << key
-                          << " = " << (parsed ? "true" : "false") << std::endl;
-                g_thread_safe_store.Set<bool>(key, parsed);
-            }
-            continue;
-        } else if (type == ThreadSafeStore::ValueType::kInt) {
-            int parsed = 0;
-            if (TryParseInt(val, parsed)) {
-                std::cout << "[StdinWriter] Set Int " << key
-                          << " = " << parsed << std::endl;
-                g_thread_safe_store.Set<int>(key, parsed);
-            }
-            continue;
-        } else if (type == ThreadSafeStore::ValueType::kDouble) {
-            double parsed = 0.0;
-            if (TryParseDouble(val, parsed)) {
-                std::cout << "[StdinWriter] Set Double " << key
-                          << " = " << parsed << std::endl;
-                g_thread_safe_store.Set<double>(key, parsed);
-            }
-            continue;
-        } else if (type == ThreadSafeStore::ValueType::kString) {
-            std::cout << "[StdinWriter] Set String " << key
-                      << " = " << val << std::endl;
-            g_thread_safe_store.Set<std::string>(key, val);
-            continue;
+    const auto type = g_thread_safe_store.GetType(key);
+    if (type == ThreadSafeStore::ValueType::kBool) {
+        bool parsed = false;
+        if (TryParseBool(val, parsed)) {
+            std::cout << "[StdinWriter] Set Bool " << key
+                      << " = " << (parsed ? "true" : "false") << std::endl;
+            g_thread_safe_store.Set<bool>(key, parsed);
+        }
+    } else if (type == ThreadSafeStore::ValueType::kInt) {
+        int parsed = 0;
+        if (TryParseInt(val, parsed)) {
+            std::cout << "[StdinWriter] Set Int " << key
+                      << " = " << parsed << std::endl;
+            g_thread_safe_store.Set<int>(key, parsed);
+        }
+    } else if (type == ThreadSafeStore::ValueType::kDouble) {
+        double parsed = 0.0;
+        if (TryParseDouble(val, parsed)) {
+            std::cout << "[StdinWriter] Set Double " << key
+                      << " = " << parsed << std::endl;
+            g_thread_safe_store.Set<double>(key, parsed);
         }
+    } else if (type == ThreadSafeStore::ValueType::kString) {
+        std::cout << "[StdinWriter] Set String " << key
+                  << " = " << val << std::endl;
+        g_thread_safe_store.Set<std::string>(key, val);
     }
 }
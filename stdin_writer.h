@@ -1,6 +1,12 @@
 #pragma once
 
+#include <string>
+
 class StdinWriter final {
 public:
+    // 標準入力を 1 行ずつ読み，fin が立つか入力が終わるまで HandleLine() に渡す．
     void Run();
+
+    // "key=value" 形式の 1 行を解釈し，g_thread_safe_store に書き込む．
+    void HandleLine(const std::string& line);
 };
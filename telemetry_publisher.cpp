@@ -0,0 +1,152 @@
+#include "telemetry_publisher.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "global_variable.h"
+#include "robot_topology.h"
+#include "thread_priority.h"
+#include "time_utils.h"
+
+namespace {
+constexpr size_t kPacketSize = TELEMETRY_HEADER_SIZE + TELEMETRY_ENTRY_SIZE * NUM_ODRIVE;
+
+std::thread publisher_thread;
+std::atomic<bool> running{false};
+
+int sock = -1;
+sockaddr_in dest_addr{};
+int64_t period_ns = 0;
+
+// 統計．送信スレッドだけが書き，停止後に表示する.
+uint64_t sent_packets = 0;
+uint64_t send_errors = 0;
+
+// "IP:PORT" を解釈する．
+bool parse_dest(const char* text, sockaddr_in& out) {
+    const std::string s = text;
+    const auto colon = s.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    const int port = std::atoi(s.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) {
+        return false;
+    }
+
+    out = sockaddr_in{};
+    out.sin_family = AF_INET;
+    out.sin_port = htons(static_cast<uint16_t>(port));
+    return inet_pton(AF_INET, s.substr(0, colon).c_str(), &out.sin_addr) == 1;
+}
+
+template<typename T>
+void put(uint8_t* p, const T& v) {
+    std::memcpy(p, &v, sizeof(T));
+}
+
+// 現在の最新値で packet を埋める．
+void fill_packet(std::array<uint8_t, kPacketSize>& packet, const uint32_t seq) {
+    const double now = now_time_sec();
+
+    put(&packet[4], seq);
+    put(&packet[8], static_cast<uint64_t>(now * 1e9));
+    packet[16] = static_cast<uint8_t>(g_thread_safe_store.Get(KEY_SYSTEM_STATE, std::memory_order_relaxed));
+
+    // 関節ごとのエントリの位置はコンパイル時に決まる.
+    robot_for_each_joint([&](auto joint) {
+        constexpr size_t i = decltype(joint)::value;
+        uint8_t* entry = &packet[TELEMETRY_HEADER_SIZE + TELEMETRY_ENTRY_SIZE * i];
+        const auto latest = g_encoder_estimates[i].Latest();
+        EncoderEstimate est{0.0f, 0.0f};
+        uint32_t age_us = TELEMETRY_AGE_NEVER;
+        if (latest) {
+            est = latest->value;
+            const double age = (now - latest->time) * 1e6;
+            age_us = (age <= 0.0) ? 0
+                   : (age >= static_cast<double>(TELEMETRY_AGE_NEVER - 1)) ? TELEMETRY_AGE_NEVER - 1
+                   : static_cast<uint32_t>(age);
+        }
+        put(entry, est.pos);
+        put(entry + 4, est.vel);
+        put(entry + 8, age_us);
+    });
+}
+
+void publisher_loop() {
+    set_fifo_priority(50);
+
+    // 変わらない部分は最初に一度だけ書いておく.
+    std::array<uint8_t, kPacketSize> packet{};
+    std::memcpy(&packet[0], TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC));
+    packet[17] = NUM_ODRIVE;
+    put(&packet[18], static_cast<uint16_t>(TELEMETRY_ENTRY_SIZE));
+
+    timespec next{};
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint32_t seq = 0;
+
+    while (running) {
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            ++next.tv_sec;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr) == EINTR) {
+        }
+
+        fill_packet(packet, seq++);
+        if (sendto(sock, packet.data(), packet.size(), MSG_DONTWAIT,
+                   reinterpret_cast<const sockaddr*>(&dest_addr), sizeof(dest_addr)) < 0) {
+            ++send_errors;
+        } else {
+            ++sent_packets;
+        }
+    }
+}
+}  // namespace
+
+void start_telemetry_publisher(const char* dest, const double rate_hz) {
+    if (rate_hz <= 0.0 || !parse_dest(dest, dest_addr)) {
+        std::cerr << "[TLM] invalid destination or rate: " << dest << std::endl;
+        return;
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        std::cerr << "[TLM] socket() failed" << std::endl;
+        return;
+    }
+
+    period_ns = static_cast<int64_t>(1e9 / rate_hz);
+    std::cout << "[TLM] start / エンコーダ値の送信開始 (" << dest << ", " << rate_hz << " Hz)." << std::endl;
+    running = true;
+    publisher_thread = std::thread(publisher_loop);
+}
+
+void stop_telemetry_publisher() {
+    if (!running) {
+        return;
+    }
+    running = false;
+    if (publisher_thread.joinable()) {
+        publisher_thread.join();
+    }
+    close(sock);
+    sock = -1;
+
+    std::cout << "[TLM] sent=" << sent_packets << " errors=" << send_errors << std::endl;
+    std::cout << "[TLM] stopped / 終了しました." << std::endl;
+}
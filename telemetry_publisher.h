@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 全 ODrive の最新のエンコーダ推定値 (g_encoder_estimates) を，一定周期で UDP に送る．
+// プランナはこれを受け取ってフィードバックに使う．送信は 1 周期につき sendto() 1 回で，
+// バッファは起動時に確保したものを使い回す．
+//
+// パケット形式 (ENC1，リトルエンディアン，合計 TELEMETRY_PACKET_SIZE バイト):
+//   [0..4)   "ENC1"
+//   [4..8)   uint32_t seq          送信ごとに 1 ずつ増える．
+//   [8..16)  uint64_t time_ns      送信時刻 (ゲートウェイの単調増加クロック) [ns]．
+//   [16]     uint8_t  system_state SystemState の値．
+//   [17]     uint8_t  node_count   続くエントリ数 (NUM_ODRIVE)．
+//   [18..20) uint16_t entry_size   1 エントリのバイト数 (TELEMETRY_ENTRY_SIZE)．
+//   以降 node_count 個 (i 番目が node_id = i + 1):
+//     float    pos     [turn]
+//     float    vel     [turn/s]
+//     uint32_t age_us  受信してからの経過時間 [us]．一度も受信していなければ 0xFFFFFFFF．
+
+constexpr char TELEMETRY_MAGIC[4] = {'E', 'N', 'C', '1'};
+constexpr size_t TELEMETRY_HEADER_SIZE = 20;
+constexpr size_t TELEMETRY_ENTRY_SIZE = 12;
+constexpr uint32_t TELEMETRY_AGE_NEVER = 0xFFFFFFFFu;
+
+// dest ("IP:PORT") に rate_hz で送信するスレッドを起動する．
+// 宛先を解釈できなければ何もしない．
+void start_telemetry_publisher(const char* dest, double rate_hz);
+void stop_telemetry_publisher();
@@ -14,3 +14,19 @@ inline void set_fifo_priority(int priority)
         std::perror("pthread_setschedparam");
     }
 }
+
+// 呼び出したスレッドを指定の CPU コアに固定する．cpu < 0 なら何もしない．
+inline void set_cpu_affinity(int cpu)
+{
+    if (cpu < 0) {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        std::perror("pthread_setaffinity_np");
+    }
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+// 時刻付きの値．
+template <typename T>
+struct Stamped {
+    double time;  // now_time_sec() 基準の時刻.
+    T value;
+};
+
+// 固定容量のリングバッファ．書き込みは 1 スレッド，読み出しは複数スレッドから行える．
+// 容量を超えると古いものから上書きするので，メモリは増えない．
+// 各スロットはシーケンス番号 (seqlock) で保護されていて，ロックを取らずに読める．
+// 読み出しは lock-free だが wait-free ではない: 最新値を読み始めてから Capacity 回 Push されると
+// そのスロットが上書きされて読み直しになる．Capacity が小さいほど (2 なら 2 回の Push で) 起きやすい．
+template <typename T, size_t Capacity>
+class ThreadSafeRing final {
+    static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+public:
+    ThreadSafeRing() = default;
+
+    ThreadSafeRing(const ThreadSafeRing&) = delete;
+    ThreadSafeRing& operator=(const ThreadSafeRing&) = delete;
+
+    // =========================
+    // Push (single producer)
+    // =========================
+    void Push(const double time, const T& value) {
+        const uint64_t index = head_.load(std::memory_order_relaxed);
+        Slot& slot = slots_[index & kMask];
+
+        const uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+        slot.seq.store(seq + 1, std::memory_order_relaxed);  // 奇数 = 書き込み中.
+        std::atomic_thread_fence(std::memory_order_release);
+
+        const Stamped<T> entry{time, value};
+        std::memcpy(&slot.entry, &entry, sizeof(entry));
+
+        slot.seq.store(seq + 2, std::memory_order_release);
+        head_.store(index + 1, std::memory_order_release);
+    }
+
+    // これまでに Push された総数 (上書きされた分も含む)．
+    uint64_t TotalPushed() const {
+        return head_.load(std::memory_order_acquire);
+    }
+
+    // 現在保持している件数．
+    size_t Size() const {
+        return static_cast<size_t>(std::min<uint64_t>(TotalPushed(), Capacity));
+    }
+
+    bool Empty() const {
+        return TotalPushed() == 0;
+    }
+
+    static constexpr size_t GetCapacity() { return Capacity; }
+
+    // =========================
+    // Latest
+    // =========================
+    // 最新値を返す．読んでいる間にそのスロットが上書きされたら head を読み直す．
+    // (それより古いスロットは先に上書きされているので，古い値に逃げることはできない．)
+    // 読み直すのは書き込み側が進んだときだけなので全体としては止まらないが，回数の上限は無い．
+    std::optional<Stamped<T>> Latest() const {
+        Stamped<T> out{};
+        for (;;) {
+            const uint64_t head = head_.load(std::memory_order_acquire);
+            if (head == 0) {
+                return std::nullopt;
+            }
+            if (ReadSlot(head - 1, out)) {
+                return out;
+            }
+        }
+    }
+
+    // =========================
+    // Windowed reads (古い順に返す)
+    // =========================
+
+    // 直近 n 件．
+    std::vector<Stamped<T>> Last(const size_t n) const {
+        const uint64_t head = head_.load(std::memory_order_acquire);
+        const uint64_t count = std::min<uint64_t>({n, head, Capacity});
+
+        std::vector<Stamped<T>> out;
+        out.reserve(count);
+        Stamped<T> entry{};
+        for (uint64_t i = head - count; i < head; ++i) {
+            // 読んでいる間に上書きされたものは読み飛ばす.
+            if (ReadSlot(i, entry)) {
+                out.push_back(entry);
+            }
+        }
+        return out;
+    }
+
+    // 時刻 t 以降 (t を含む) のもの．
+    std::vector<Stamped<T>> Since(const double t) const {
+        const uint64_t head = head_.load(std::memory_order_acquire);
+        const uint64_t oldest = (head > Capacity) ? head - Capacity : 0;
+
+        uint64_t first = head;
+        Stamped<T> entry{};
+        while (first > oldest) {
+            if (!ReadSlot(first - 1, entry) || entry.time < t) {
+                break;
+            }
+            --first;
+        }
+        return Last(head - first);
+    }
+
+private:
+    static constexpr uint64_t kMask = Capacity - 1;
+
+    struct Slot {
+        // 書き込み回数の 2 倍．書き込み中は奇数になる.
+        std::atomic<uint64_t> seq{0};
+        Stamped<T> entry{};
+    };
+
+    // index 番目に Push された値を読む．上書き済み・書き込み中なら false．
+    bool ReadSlot(const uint64_t index, Stamped<T>& out) const {
+        const Slot& slot = slots_[index & kMask];
+        const uint64_t expected = 2 * (index / Capacity + 1);
+
+        const uint64_t before = slot.seq.load(std::memory_order_acquire);
+        if (before != expected) {
+            return false;
+        }
+        std::memcpy(&out, &slot.entry, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.seq.load(std::memory_order_relaxed) == expected;
+    }
+
+    alignas(64) std::atomic<uint64_t> head_{0};
+    alignas(64) std::array<Slot, Capacity> slots_{};
+};
@@ -1,16 +1,38 @@
 #pragma once
 
 #include <any>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <mutex>
 #include <optional>
 #include <shared_mutex>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <typeinfo>
 #include <unordered_map>
+#include <vector>
+
+// ThreadSafeStore の型付きキー．
+// 8 バイト以下の trivially copyable な値だけを扱い，値はキャッシュライン単位で
+// 分けたアトミック変数に置かれる．毎周期読むフラグなどはこちらを使うこと．
+// slot はキーごとに一意な番号 (0 .. ThreadSafeStore::kMaxTypedKeys - 1) を振る．
+template <typename T>
+struct StoreKey {
+    const char* name;
+    size_t slot;
+};
 
 class ThreadSafeStore final {
 public:
+    static constexpr size_t kMaxTypedKeys = 16;
+
     enum class ValueType {
         kMissing,
         kBool,
@@ -26,13 +48,124 @@ public:
     ThreadSafeStore(const ThreadSafeStore&) = delete;
     ThreadSafeStore& operator=(const ThreadSafeStore&) = delete;
 
+    // =========================
+    // Declare (typed key)
+    // =========================
+    // 型付きキーを初期値とともに登録する．以後は文字列キーからも同じ値を読み書きできる．
+    // 各スレッドが使い始める前に呼ぶこと．
+    template <typename T>
+    void Declare(const StoreKey<T>& key, const T& initial) {
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            if (key.slot >= kMaxTypedKeys) {
+                throw std::runtime_error(std::string("Typed key slot out of range: ") + key.name);
+            }
+            for (const auto& [name, entry] : typed_) {
+                if (entry.slot == key.slot && name != key.name) {
+                    throw std::runtime_error(std::string("Typed key slot conflict: ") + key.name);
+                }
+            }
+            typed_[key.name] = TypedEntry{key.slot, &typeid(T)};
+            data_.erase(key.name);
+        }
+        Set(key, initial);
+    }
+
+    // =========================
+    // Set / Get (typed key, lock-free)
+    // =========================
+    template <typename T>
+    void Set(const StoreKey<T>& key, const T& val) {
+        StoreAtomic(key.slot, val);
+    }
+
+    template <typename T>
+    T Get(const StoreKey<T>& key,
+          const std::memory_order order = std::memory_order_acquire) const {
+        return LoadAtomic<T>(key.slot, order);
+    }
+
+    // =========================
+    // Version (change counter)
+    // =========================
+    // 書き込み (同じ値の再設定も含む) のたびに増える．Declare 直後は 1．
+    template <typename T>
+    uint64_t Version(const StoreKey<T>& key) const {
+        return slots_[key.slot].version.load();
+    }
+
+    // いずれかのキーへの書き込みのたびに増える．
+    uint64_t Version() const {
+        return global_version_.load();
+    }
+
+    // =========================
+    // WaitForChange (blocking)
+    // =========================
+    // key の Version() が since から変わるまで待つ．変わったら true，タイムアウトなら false．
+    template <typename T, typename Rep, typename Period>
+    bool WaitForChange(const StoreKey<T>& key, const uint64_t since,
+                       const std::chrono::duration<Rep, Period>& timeout) const {
+        return WaitUntil([&] { return Version(key) != since; }, timeout);
+    }
+
+    // いずれかのキーが書き込まれて Version() が since から変わるまで待つ．
+    // 複数のキー (状態と終了フラグなど) を同時に待つときに使う．
+    template <typename Rep, typename Period>
+    bool WaitForAnyChange(const uint64_t since,
+                          const std::chrono::duration<Rep, Period>& timeout) const {
+        return WaitUntil([&] { return Version() != since; }, timeout);
+    }
+
+    // =========================
+    // Subscribe (callback)
+    // =========================
+    // key への書き込みのたびに，書き込んだスレッド上で callback(新しい値) を呼ぶ．
+    // callback の中でこのストアに書き込んだり，購読を増減させたりしないこと．
+    // 戻り値は Unsubscribe() に渡す ID．
+    template <typename T, typename Callback>
+    size_t Subscribe(const StoreKey<T>& key, Callback callback) {
+        std::lock_guard<std::mutex> lock(subs_mutex_);
+        const size_t id = ++last_sub_id_;
+        subs_.push_back(Subscription{id, key.slot, [cb = std::move(callback)](const uint64_t bits) {
+            static_assert(std::is_invocable_v<Callback, const T&>, "callback must take const T&");
+            T val;
+            std::memcpy(&val, &bits, sizeof(T));
+            cb(val);
+        }});
+        slots_[key.slot].subscribers.fetch_add(1);
+        return id;
+    }
+
+    void Unsubscribe(const size_t id) {
+        std::lock_guard<std::mutex> lock(subs_mutex_);
+        for (auto it = subs_.begin(); it != subs_.end(); ++it) {
+            if (it->id == id) {
+                slots_[it->slot].subscribers.fetch_sub(1);
+                subs_.erase(it);
+                return;
+            }
+        }
+    }
+
     // =========================
     // Set (write exclusive)
     // =========================
     template <typename T>
     void Set(const std::string& key, const T& val) {
-        std::unique_lock<std::shared_mutex> lock(mutex_);
-        data_[key] = val;
+        if (const auto typed = FindTyped<T>(key)) {
+            if constexpr (kAtomicCompatible<T>) {
+                StoreAtomic(*typed, val);
+            }
+            return;
+        }
+
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            data_[key] = val;
+        }
+        global_version_.fetch_add(1);
+        NotifyWaiters();
     }
 
     // =========================
@@ -40,6 +173,12 @@ public:
     // =========================
     template <typename T>
     T Get(const std::string& key) const {
+        if (const auto typed = FindTyped<T>(key)) {
+            if constexpr (kAtomicCompatible<T>) {
+                return LoadAtomic<T>(*typed, std::memory_order_acquire);
+            }
+        }
+
         std::shared_lock<std::shared_mutex> lock(mutex_);
 
         auto it = data_.find(key);
@@ -59,6 +198,16 @@ public:
     // =========================
     template <typename T>
     std::optional<T> TryGet(const std::string& key) const {
+        try {
+            if (const auto typed = FindTyped<T>(key)) {
+                if constexpr (kAtomicCompatible<T>) {
+                    return LoadAtomic<T>(*typed, std::memory_order_acquire);
+                }
+            }
+        } catch (...) {
+            return std::nullopt;
+        }
+
         std::shared_lock<std::shared_mutex> lock(mutex_);
 
         auto it = data_.find(key);
@@ -78,7 +227,7 @@ public:
     // =========================
     bool Has(const std::string& key) const {
         std::shared_lock<std::shared_mutex> lock(mutex_);
-        return data_.count(key) > 0;
+        return typed_.count(key) > 0 || data_.count(key) > 0;
     }
 
     // =========================
@@ -87,12 +236,16 @@ public:
     ValueType GetType(const std::string& key) const {
         std::shared_lock<std::shared_mutex> lock(mutex_);
 
-        const auto it = data_.find(key);
-        if (it == data_.end()) {
+        const std::type_info* type_ptr = nullptr;
+        if (const auto typed = typed_.find(key); typed != typed_.end()) {
+            type_ptr = typed->second.type;
+        } else if (const auto it = data_.find(key); it != data_.end()) {
+            type_ptr = &it->second.type();
+        } else {
             return ValueType::kMissing;
         }
 
-        const std::type_info& type = it->second.type();
+        const std::type_info& type = *type_ptr;
         if (type == typeid(bool)) {
             return ValueType::kBool;
         }
@@ -109,6 +262,108 @@ public:
     }
 
 private:
+    template <typename T>
+    static constexpr bool kAtomicCompatible =
+        std::is_trivially_copyable_v<T> && sizeof(T) <= sizeof(uint64_t);
+
+    struct TypedEntry {
+        size_t slot;
+        const std::type_info* type;
+    };
+
+    // 偽共有を避けるため，1 スロットを 1 キャッシュラインに置く．
+    struct alignas(64) AtomicSlot {
+        std::atomic<uint64_t> bits{0};
+        std::atomic<uint64_t> version{0};
+        std::atomic<int> subscribers{0};
+    };
+
+    struct Subscription {
+        size_t id;
+        size_t slot;
+        std::function<void(uint64_t)> callback;
+    };
+
+    template <typename Pred, typename Rep, typename Period>
+    bool WaitUntil(Pred changed, const std::chrono::duration<Rep, Period>& timeout) const {
+        if (changed()) {
+            return true;
+        }
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        waiters_.fetch_add(1);
+        const bool result = wait_cv_.wait_for(lock, timeout, changed);
+        waiters_.fetch_sub(1);
+        return result;
+    }
+
+    // 待っているスレッドがいるときだけ起こす．
+    // 待つ側は waiters_ を増やしてから版数を確認するので，取りこぼしは起きない．
+    void NotifyWaiters() {
+        if (waiters_.load() == 0) {
+            return;
+        }
+        { std::lock_guard<std::mutex> lock(wait_mutex_); }
+        wait_cv_.notify_all();
+    }
+
+    void NotifySubscribers(const size_t slot, const uint64_t bits) {
+        if (slots_[slot].subscribers.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(subs_mutex_);
+        for (const auto& sub : subs_) {
+            if (sub.slot == slot) {
+                sub.callback(bits);
+            }
+        }
+    }
+
+    // 文字列キーが型付きキーとして登録されていればそのスロット番号を返す．
+    template <typename T>
+    std::optional<size_t> FindTyped(const std::string& key) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        const auto it = typed_.find(key);
+        if (it == typed_.end()) {
+            return std::nullopt;
+        }
+        if (*it->second.type != typeid(T)) {
+            throw std::runtime_error("Type mismatch for key: " + key);
+        }
+        return it->second.slot;
+    }
+
+    template <typename T>
+    void StoreAtomic(const size_t slot, const T& val) {
+        static_assert(kAtomicCompatible<T>,
+                      "StoreKey value must be trivially copyable and at most 8 bytes");
+        uint64_t bits = 0;
+        std::memcpy(&bits, &val, sizeof(T));
+        slots_[slot].bits.store(bits, std::memory_order_release);
+        slots_[slot].version.fetch_add(1);
+        global_version_.fetch_add(1);
+        NotifyWaiters();
+        NotifySubscribers(slot, bits);
+    }
+
+    template <typename T>
+    T LoadAtomic(const size_t slot, const std::memory_order order) const {
+        const uint64_t bits = slots_[slot].bits.load(order);
+        T val;
+        std::memcpy(&val, &bits, sizeof(T));
+        return val;
+    }
+
     mutable std::shared_mutex mutex_;
     std::unordered_map<std::string, std::any> data_;
+    std::unordered_map<std::string, TypedEntry> typed_;
+    std::array<AtomicSlot, kMaxTypedKeys> slots_{};
+
+    alignas(64) std::atomic<uint64_t> global_version_{0};
+    mutable std::atomic<int> waiters_{0};
+    mutable std::mutex wait_mutex_;
+    mutable std::condition_variable wait_cv_;
+
+    std::mutex subs_mutex_;
+    std::vector<Subscription> subs_;
+    size_t last_sub_id_ = 0;
 };
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <time.h>
+
 #include <chrono>
 
 inline double now_time_sec() {
@@ -7,3 +9,13 @@ inline double now_time_sec() {
     static const auto t0 = clock::now();
     return std::chrono::duration<double>(clock::now() - t0).count();
 }
+
+// CLOCK_REALTIME の時刻 (カーネルの受信タイムスタンプなど) を now_time_sec() と同じ基準に変換する．
+// 現在時刻との差を取って引き戻すので，変換の直前に壁時計が補正されない限り正確．
+inline double realtime_to_time_sec(const timespec& ts) {
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    const double age = static_cast<double>(now.tv_sec - ts.tv_sec)
+                     + static_cast<double>(now.tv_nsec - ts.tv_nsec) * 1e-9;
+    return now_time_sec() - age;
+}
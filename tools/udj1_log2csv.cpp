@@ -0,0 +1,90 @@
+// UDJ1 コマンドロガーのバイナリログ (log_udp_*.bin) を，
+// 従来の log_udp_*.csv と同じ形式の CSV に変換する．
+//
+// 使い方: udj1_log2csv <input.bin> [output.csv]
+// 出力先を省略すると，拡張子を .csv に置き換えたパスに書き出す．
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "log_format.h"
+
+namespace {
+
+std::string default_output_path(const std::string& input) {
+    const auto dot = input.find_last_of('.');
+    const auto slash = input.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return input + ".csv";
+    }
+    return input.substr(0, dot) + ".csv";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <input.bin> [output.csv]" << std::endl;
+        return 1;
+    }
+
+    const std::string in_path = argv[1];
+    const std::string out_path = (argc >= 3) ? argv[2] : default_output_path(in_path);
+
+    std::ifstream ifs(in_path, std::ios::binary);
+    if (!ifs.is_open()) {
+        std::cerr << "[LOG2CSV] cannot open " << in_path << std::endl;
+        return 1;
+    }
+
+    UdjLogHeader header{};
+    if (!ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, UDJ_LOG_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << "[LOG2CSV] not a UDJ1 binary log: " << in_path << std::endl;
+        return 1;
+    }
+    if (header.version > UDJ_LOG_VERSION) {
+        std::cerr << "[LOG2CSV] unsupported version " << header.version << std::endl;
+        return 1;
+    }
+    if (header.header_size < sizeof(header) ||
+        header.row_size < udj_log_row_size(header.joint_count, header.version)) {
+        std::cerr << "[LOG2CSV] broken header" << std::endl;
+        return 1;
+    }
+    ifs.seekg(header.header_size);
+
+    std::ofstream ofs(out_path);
+    if (!ofs.is_open()) {
+        std::cerr << "[LOG2CSV] cannot open " << out_path << std::endl;
+        return 1;
+    }
+
+    udj_log_write_csv_header(ofs, header.joint_count, header.version);
+
+    // version 1 / 2 の行は joint の後ろが短い．足りない部分は 0 のまま.
+    const size_t joints_size = sizeof(float) * header.joint_count;
+    const size_t tail_size = std::min<size_t>(header.row_size - sizeof(double) - joints_size,
+                                              sizeof(UdjLogRowTail));
+    std::vector<char> row(header.row_size);
+    std::vector<float> joint(header.joint_count);
+    size_t rows = 0;
+    // 書き込み途中で止まったファイルの末尾の半端な行は読み捨てる.
+    while (ifs.read(row.data(), row.size())) {
+        double time = 0.0;
+        UdjLogRowTail tail{};
+        std::memcpy(&time, row.data(), sizeof(double));
+        std::memcpy(joint.data(), row.data() + sizeof(double), joints_size);
+        std::memcpy(&tail, row.data() + sizeof(double) + joints_size, tail_size);
+        udj_log_write_csv_row(ofs, time, joint.data(), header.joint_count, header.version, tail);
+        ++rows;
+    }
+
+    std::cout << "[LOG2CSV] wrote " << rows << " rows to " << out_path << std::endl;
+    return 0;
+}
@@ -3,39 +3,115 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cstring>
 #include <cerrno>
 #include <iostream>
+#include <string>
 #include <thread>
 
 #include "udj1_handler.h"
 
+#include "can_bus_load.h"
+#include "can_topology.h"
+#include "can_tx.h"
 #include "can_utils.h"
 #include "system_state.h"
+#include "log_format.h"
 #include "logger.h"
+#include "output_scheduler.h"
+#include "setpoint_suppressor.h"
 #include "thread_priority.h"
 #include "global_variable.h"
 #include "time_utils.h"
+#include "udj1_protocol.h"
+#include "udj1_session.h"
 
 constexpr int UDP_UDJ1_PORT = 50000;
-constexpr int EXPECTED_COUNT = 16;
+constexpr int EXPECTED_COUNT = UDJ1_JOINT_COUNT;  // angles[i] は node_id = i + 1 に送られる.
+constexpr int RECV_TIMEOUT_MS = 100;  // スレッドモードで fin を確認する間隔.
+constexpr size_t RECV_BATCH = 32;  // recvmmsg() 1 回で受け取る最大データグラム数.
+constexpr size_t RECV_BUF_SIZE = 1024;
+constexpr double CAN_BUS_LOAD_WARN = 0.8;          // ☆ 1 秒間の使用率がこれを越えたら警告する.
+constexpr double CAN_BUS_LOAD_WARN_INTERVAL = 10.0;  // 警告を繰り返す間隔 [sec].
 
-static const int NODE_ID[EXPECTED_COUNT] = {
-    1, 2, 3, 4,
-    5, 6, 7, 8,
-    9, 10, 11, 12,
-    13, 14, 15, 16
+static std::thread udj1_thread;
+
+// 溜まっていたパケットのうち，新しいものに置き換えて CAN に送らなかった数．
+static uint64_t coalesced_packets = 0;
+static uint64_t coalesced_cycles = 0;  // 1 つ以上読み飛ばした回数.
+static uint64_t max_skipped_per_cycle = 0;
+static uint64_t bad_length_packets = 0;  // 長さが合わず捨てた UDJ1 パケット.
+static size_t last_bad_length = 0;
+
+// recvmmsg() の受信バッファ．受信は 1 スレッドだけなので static に持つ.
+struct RecvBatch {
+    uint8_t bufs[RECV_BATCH][RECV_BUF_SIZE];
+    iovec iov[RECV_BATCH];
+    alignas(cmsghdr) char ctrl[RECV_BATCH][CMSG_SPACE(sizeof(timespec))];
+    mmsghdr msgs[RECV_BATCH];
 };
+static RecvBatch batch;
 
-static std::thread udj1_thread;
+// RUN 1 回分の受信統計 (欠落・順序・遅延)．RUN を抜けたときと終了時に表示する.
+static Udj1SessionStats session;
+static bool session_active = false;
+static double run_since = 0.0;  // RUN に入った時刻．これより前に受信したパケットは送らない.
+static double run_left_at = 0.0;  // 前回 RUN を抜けたのに気づいた時刻.
 
-static void udj1_loop() {
-	set_fifo_priority(80);
+// KEY_SYSTEM_STATE が RUN に変わった時刻．書き込んだスレッド上の購読で記録する
+// (受信側が状態の変化に気づくのはデータグラムが届いた後なので，その時刻では遅すぎる)．
+static std::atomic<double> run_entered_at{0.0};
+static bool state_was_run = false;  // 購読の中だけで使う.
+static size_t state_sub = 0;
+
+static void watch_system_state() {
+    state_was_run = g_thread_safe_store.Get(KEY_SYSTEM_STATE) == SystemState::RUN;
+    state_sub = g_thread_safe_store.Subscribe(KEY_SYSTEM_STATE, [](const SystemState& state) {
+        const bool is_run = state == SystemState::RUN;
+        if (is_run && !state_was_run) {
+            run_entered_at.store(now_time_sec(), std::memory_order_release);
+        }
+        state_was_run = is_run;
+    });
+}
+
+static void unwatch_system_state() {
+    if (state_sub != 0) {
+        g_thread_safe_store.Unsubscribe(state_sub);
+        state_sub = 0;
+    }
+}
+
+// RUN 1 回分の CAN バス使用率．index はインタフェースの番号 (can_topology.h)．
+static std::array<CanBusLoadMeter, CAN_MAX_BUSES> bus_loads;
+static double bus_load_warned = -CAN_BUS_LOAD_WARN_INTERVAL;
+
+// 直接送信するときの，変化の小さい関節の間引き (udj1_set_change_suppression())．
+static SetpointSuppressor<EXPECTED_COUNT> suppressor;
+
+// 受信時刻付きの UDJ1 パケット．
+struct Udj1Frame {
+    double time;
+    Udj1Packet packet;
+};
+
+static UdjLogRowTail log_tail_of(const Udj1Packet& packet, const uint32_t flags) {
+    UdjLogRowTail tail{};
+    tail.flags = flags | (packet.has_seq ? UDJ_LOG_FLAG_HAS_SEQ : 0);
+    tail.seq = packet.seq;
+    tail.sender_ns = packet.sender_ns;
+    return tail;
+}
+
+static int open_socket(const bool nonblocking) {
     const int sock = socket(AF_INET, SOCK_DGRAM, 0);
     if (sock < 0) {
         std::cerr << "[UDJ1] socket() failed" << std::endl;
-        return;
+        return -1;
     }
 
     sockaddr_in addr{};
@@ -45,53 +121,269 @@ static void udj1_loop() {
     if (bind(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
         std::cerr << "[UDJ1] bind() failed" << std::endl;
         close(sock);
-        return;
+        return -1;
+    }
+
+    // 受信時刻はカーネルが付けたものを使う (まとめて読んでもパケットごとに正しい時刻になる).
+    const int enable = 1;
+    setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+
+    if (nonblocking) {
+        const int flags = fcntl(sock, F_GETFL, 0);
+        if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+            std::cerr << "[UDJ1] fcntl(O_NONBLOCK) failed" << std::endl;
+            close(sock);
+            return -1;
+        }
+    } else {
+        // パケットが来なくても fin を確認できるよう，受信待ちに時間制限を付ける.
+        timeval tv{};
+        tv.tv_usec = RECV_TIMEOUT_MS * 1000;
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
     }
+    return sock;
+}
 
-    // ☆ 非ブロッキングモードにする場合. 以下を有効化する.
-    // const int flags = fcntl(sock, F_GETFL, 0);
-    // if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
-    //     std::cerr << "[UDJ1] fcntl(O_NONBLOCK) failed" << std::endl;
-    //     close(sock);
-    //     return;
-    // }
+static double rx_time_of(const msghdr& msg) {
+    for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(const_cast<msghdr*>(&msg), c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec ts{};
+            std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            return realtime_to_time_sec(ts);
+        }
+    }
+    return now_time_sec();
+}
 
-    uint8_t buf[1024];
+// 最新の指令値を CAN の送信スケジューラ (can_tx.h) に積む (または周期送信スケジューラに渡す)．
+// 受信から受け渡しまでの時間をログと統計に残す (実際の書き込みまでは [CANTX] の統計を見る)．
+static void transmit(const Udj1Frame& frame) {
+    const float* angles = frame.packet.angles;
 
-    while (!g_thread_safe_store.Get<bool>("fin")) {
-        const auto state = g_thread_safe_store.Get<SystemState>("system_state");
-        if (state != SystemState::RUN) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            continue;
+    // 周期送信スケジューラが動いていれば，指令値を渡すだけで送信は任せる.
+    if (output_scheduler_enabled()) {
+        output_scheduler_set(frame.time, angles, EXPECTED_COUNT);
+    } else if (suppressor.Enabled()) {
+        suppressor.Forget(can_tx_take_dropped_setpoints());
+        const uint32_t mask = suppressor.Select(frame.time, angles, EXPECTED_COUNT);
+        send_positions(angles, EXPECTED_COUNT, mask);
+        suppressor.Commit(frame.time, angles, EXPECTED_COUNT, mask);
+    } else {
+        send_positions(angles, EXPECTED_COUNT);
+    }
+
+    const double latency = now_time_sec() - frame.time;
+    session.RecordTxLatency(latency);
+    UdjLogRowTail tail = log_tail_of(frame.packet, 0);
+    tail.tx_latency_us = static_cast<float>(latency * 1e6);
+    logger_push(frame.time, angles, tail);
+}
+
+// recvmmsg() で 1 回分受信する．受信数を返す．来ていなければ 0，エラーなら -1．
+static int receive_batch(const int sock, const int flags) {
+    for (size_t i = 0; i < RECV_BATCH; ++i) {
+        batch.iov[i] = {batch.bufs[i], RECV_BUF_SIZE};
+        msghdr& h = batch.msgs[i].msg_hdr;
+        h = msghdr{};
+        h.msg_iov = &batch.iov[i];
+        h.msg_iovlen = 1;
+        h.msg_control = batch.ctrl[i];
+        h.msg_controllen = sizeof(batch.ctrl[i]);
+    }
+
+    const int n = recvmmsg(sock, batch.msgs, RECV_BATCH, flags, nullptr);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        std::cerr << "[UDJ1] recvmmsg() failed" << std::endl;
+        return -1;
+    }
+    return n;
+}
+
+// ソケットに溜まっているデータグラムを読み切り，最新の UDJ1 パケットだけを送る．
+// 古いものは coalesced としてログにだけ残す．version 2 のパケットで，通し番号が
+// 送信済みのものより古い (順序入れ替わり・重複) ものも送らずにログにだけ残す．first_flags は最初の recvmmsg() に渡すフラグ
+// (スレッドモードでは MSG_WAITFORONE で 1 つ目を待つ)．process が false なら読み捨てる．
+// RUN に入る前に受信していたもの (run_since より古いもの) も読み捨てる．
+// エラーなら false を返す．
+static bool drain_socket(const int sock, const int first_flags, const bool process) {
+    Udj1Frame latest{};
+    bool has_latest = false;
+    uint64_t skipped = 0;
+
+    int flags = first_flags;
+    for (;;) {
+        const int n = receive_batch(sock, flags);
+        if (n < 0) {
+            return false;
         }
+        for (int i = 0; process && i < n; ++i) {
+            Udj1Frame frame{};
+            const Udj1ParseResult parsed = udj1_parse(batch.bufs[i], batch.msgs[i].msg_len, frame.packet);
+            if (parsed == Udj1ParseResult::kBadLength) {
+                ++bad_length_packets;
+                last_bad_length = batch.msgs[i].msg_len;
+            }
+            if (parsed != Udj1ParseResult::kOk) {
+                continue;
+            }
+            frame.time = rx_time_of(batch.msgs[i].msg_hdr);
+            if (frame.time < run_since) {
+                continue;
+            }
 
-        const ssize_t len = recvfrom(sock, buf, sizeof(buf), 0, nullptr, nullptr);
-        if (len < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            const auto order = session.Observe(frame.packet.has_seq, frame.packet.seq,
+                                               frame.packet.sender_ns, frame.time);
+            if (order == Udj1SeqTracker::Result::kReordered || order == Udj1SeqTracker::Result::kDuplicate) {
+                const uint32_t flag = (order == Udj1SeqTracker::Result::kReordered)
+                                    ? UDJ_LOG_FLAG_REORDERED : UDJ_LOG_FLAG_DUPLICATE;
+                logger_push(frame.time, frame.packet.angles, log_tail_of(frame.packet, flag));
                 continue;
             }
-            std::cerr << "[UDJ1] recvfrom() failed" << std::endl;
+
+            if (has_latest) {
+                logger_push(latest.time, latest.packet.angles,
+                            log_tail_of(latest.packet, UDJ_LOG_FLAG_COALESCED));
+                ++skipped;
+            }
+            latest = frame;
+            has_latest = true;
+        }
+        // 受信バッファを満たした場合だけ，まだ残っている可能性がある.
+        if (n < static_cast<int>(RECV_BATCH)) {
             break;
         }
-        if (len < 8 + EXPECTED_COUNT * 4) { continue; }
-        if (std::memcmp(buf, "UDJ1", 4) != 0) { continue; }
-
-        float* angles = reinterpret_cast<float*>(buf + 8);
-        const double t = now_time_sec();
-		
-		logger_push(t, angles);
-        for (int i = 0; i < EXPECTED_COUNT; i++) {
-            send_position(NODE_ID[i], angles[i]);
+        flags = MSG_DONTWAIT;
+    }
+
+    if (skipped > 0) {
+        coalesced_packets += skipped;
+        ++coalesced_cycles;
+        max_skipped_per_cycle = std::max(max_skipped_per_cycle, skipped);
+    }
+    if (has_latest) {
+        transmit(latest);
+    }
+
+    if (process) {
+        const double now = now_time_sec();
+        for (size_t bus = 0; bus < can_bus_count(); ++bus) {
+            auto& meter = bus_loads[bus];
+            if (meter.Sample(now) && meter.LastLoad() >= CAN_BUS_LOAD_WARN
+                && now - bus_load_warned >= CAN_BUS_LOAD_WARN_INTERVAL) {
+                std::cerr << "[CAN] " << can_bus_name(bus) << " bus load " << meter.LastLoad() * 100.0
+                          << "% / CAN バスの使用率が高くなっています." << std::endl;
+                bus_load_warned = now;
+            }
+        }
+    }
+    return true;
+}
+
+// RUN に入ったら統計を取り直し，抜けたら表示する.
+static void update_session(const bool running) {
+    if (running && !session_active) {
+        // 購読より前から RUN だった場合や，購読がまだ今回の時刻を書いていない場合は，気づいた時刻から.
+        const double entered = run_entered_at.load(std::memory_order_acquire);
+        run_since = (entered > run_left_at) ? entered : now_time_sec();
+        session.Reset();
+        suppressor.Reset();
+        for (size_t bus = 0; bus < can_bus_count(); ++bus) {
+            bus_loads[bus].Reset(bus, now_time_sec());
+        }
+    } else if (!running && session_active) {
+        run_left_at = now_time_sec();
+        if (!session.Empty()) {
+            session.Print(std::cout);
+            for (size_t bus = 0; bus < can_bus_count(); ++bus) {
+                const std::string prefix = std::string("[CAN] ") + can_bus_name(bus) + " bus load";
+                bus_loads[bus].Print(std::cout, prefix.c_str(), now_time_sec());
+            }
+        }
+    }
+    session_active = running;
+}
+
+static void udj1_loop() {
+	set_fifo_priority(80);
+    const int sock = open_socket(false);
+    if (sock < 0) {
+        return;
+    }
+
+    while (!g_thread_safe_store.Get(KEY_FIN)) {
+        const uint64_t version = g_thread_safe_store.Version();
+        const auto state = g_thread_safe_store.Get(KEY_SYSTEM_STATE);
+        update_session(state == SystemState::RUN);
+        if (state != SystemState::RUN) {
+            // RUN 以外で届いたものは読み捨て，状態が変わるまで眠る．fin の書き込みでも起きる.
+            if (!drain_socket(sock, MSG_DONTWAIT, false)) {
+                break;
+            }
+            g_thread_safe_store.WaitForAnyChange(version, std::chrono::milliseconds(500));
+            continue;
+        }
+
+        // 1 つ目が届くまで (最大 RECV_TIMEOUT_MS) 待ち，届いたら溜まっている分をまとめて読む.
+        if (!drain_socket(sock, MSG_WAITFORONE, true)) {
+            break;
         }
     }
 
     close(sock);
 }
 
+void udj1_set_change_suppression(const SuppressionConfig& config) {
+    suppressor.Configure(config);
+}
+
+int udj1_open_socket() {
+    const int sock = open_socket(true);
+    if (sock >= 0) {
+        watch_system_state();
+    }
+    return sock;
+}
+
+void udj1_close_socket(const int sock) {
+    unwatch_system_state();
+    close(sock);
+}
+
+void udj1_on_state_change() {
+    update_session(g_thread_safe_store.Get(KEY_SYSTEM_STATE) == SystemState::RUN);
+}
+
+void udj1_on_readable(const int sock) {
+    const bool running = g_thread_safe_store.Get(KEY_SYSTEM_STATE) == SystemState::RUN;
+    update_session(running);
+    drain_socket(sock, MSG_DONTWAIT, running);
+}
+
+void udj1_report() {
+    update_session(false);
+    if (coalesced_packets > 0) {
+        std::cout << "[UDJ1] coalesced packets=" << coalesced_packets
+                  << " cycles=" << coalesced_cycles
+                  << " max_per_cycle=" << max_skipped_per_cycle << std::endl;
+    }
+    if (bad_length_packets > 0) {
+        std::cout << "[UDJ1] rejected packets with wrong length=" << bad_length_packets
+                  << " (last " << last_bad_length << " bytes, expected " << UDJ1_V1_SIZE
+                  << " or " << UDJ1_V2_SIZE << ")" << std::endl;
+    }
+    if (suppressor.Enabled() && suppressor.Selected() + suppressor.Suppressed() > 0) {
+        std::cout << "[UDJ1] change suppression: sent=" << suppressor.Selected()
+                  << " suppressed=" << suppressor.Suppressed() << " frames" << std::endl;
+    }
+}
+
 void start_udj1_thread() {
     std::cout << "[UDJ1] start / UDJ1パケット受信開始." << std::endl;
     
+    watch_system_state();
     udj1_thread = std::thread(udj1_loop);
 }
 
@@ -99,6 +391,8 @@ void stop_udj1_thread() {
     if (udj1_thread.joinable()) {
         udj1_thread.join();
     }
+    unwatch_system_state();
 
+    udj1_report();
     std::cout << "[UDJ1] stopped / 終了しました." << std::endl;
 }
@@ -2,5 +2,31 @@
 
 // UDJ1 UDPパケットを受信して、各ジョイント角度を CAN に送信する．
 // SystemStateが RUN の間だけ処理を行う．
+// 処理が遅れてパケットが溜まった場合は，最新のものだけを送り，古いものはログに coalesced として残す．
+// RUN の間の CAN バス使用率 (can_bus_load.h) も，RUN を抜けたときにインタフェースごとに表示する．
+
+struct SuppressionConfig;
+
+// 直接送信するとき (周期送信スケジューラを使わないとき) に，変化の小さい関節を送らないようにする
+// (setpoint_suppressor.h)．スレッドの起動前に呼ぶこと．
+void udj1_set_change_suppression(const SuppressionConfig& config);
+
 void start_udj1_thread();
 void stop_udj1_thread();
+
+// ===== リアクタモード用 (reactor.h) =====
+
+// ノンブロッキングの UDJ1 受信ソケットを開く．失敗時は -1．
+// RUN に入った時刻を記録するため KEY_SYSTEM_STATE も購読するので，udj1_close_socket() で閉じること．
+int udj1_open_socket();
+void udj1_close_socket(int sock);
+
+// sock に届いているデータグラムをすべて処理する．RUN 以外のときは読み捨てる．
+void udj1_on_readable(int sock);
+
+// KEY_SYSTEM_STATE が書かれたら呼ぶ．RUN に入ったら統計を取り直し，抜けたら表示する
+// (スレッドモードの udj1_loop() が状態の変化で起きるのと同じ)．
+void udj1_on_state_change();
+
+// 送信統計を表示する．
+void udj1_report();
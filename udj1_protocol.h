@@ -0,0 +1,64 @@
+#pragma once
+
+// UDJ1 パケット (UDP 50000 番) の形式．
+//
+// version 1 (72 バイト．関節数 UDJ1_JOINT_COUNT が 16 の場合．以下のオフセットも同じ):
+//   [0..4)   "UDJ1"
+//   [4..8)   未使用
+//   [8..72)  float angles[16] (angles[i] は node_id = i + 1 宛て)
+//
+// version 2 (80 バイト): version 1 の後ろに送信時刻を足したもの．
+//   [4..8)   uint32_t seq       送信ごとに 1 ずつ増やす通し番号 (一周してよい)．
+//   [72..80) uint64_t sender_ns 送信側の単調増加クロック (CLOCK_MONOTONIC など) [ns]．
+//
+// version 2 のパケットも先頭 72 バイトは version 1 と同じなので，古いゲートウェイでもそのまま動く．
+// 長さが UDJ1_V1_SIZE なら version 1，UDJ1_V2_SIZE なら version 2 として扱う．それ以外の長さは
+// 関節数が送信側と合っていないので捨てる (先頭の関節だけ動かしたり，余りを読み捨てたりしない)．
+// 値はすべてリトルエンディアン．
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "robot_topology.h"
+
+constexpr char UDJ1_MAGIC[4] = {'U', 'D', 'J', '1'};
+constexpr size_t UDJ1_JOINT_COUNT = ROBOT_JOINT_COUNT;  // 送信側と合わせること.
+constexpr size_t UDJ1_SEQ_OFFSET = 4;
+constexpr size_t UDJ1_ANGLES_OFFSET = 8;
+constexpr size_t UDJ1_V1_SIZE = UDJ1_ANGLES_OFFSET + sizeof(float) * UDJ1_JOINT_COUNT;
+constexpr size_t UDJ1_SENDER_TIME_OFFSET = UDJ1_V1_SIZE;
+constexpr size_t UDJ1_V2_SIZE = UDJ1_SENDER_TIME_OFFSET + sizeof(uint64_t);
+
+struct Udj1Packet {
+    bool has_seq;        // version 2 なら true．
+    uint32_t seq;
+    uint64_t sender_ns;
+    float angles[UDJ1_JOINT_COUNT];
+};
+
+enum class Udj1ParseResult {
+    kOk,
+    kNotUdj1,    // 先頭が "UDJ1" でない．
+    kBadLength,  // "UDJ1" だが長さが UDJ1_V1_SIZE でも UDJ1_V2_SIZE でもない (関節数の不一致)．
+};
+
+// buf を UDJ1 パケットとして解釈する．kOk のときだけ out に書く．
+inline Udj1ParseResult udj1_parse(const uint8_t* buf, const size_t len, Udj1Packet& out) {
+    if (len < sizeof(UDJ1_MAGIC) || std::memcmp(buf, UDJ1_MAGIC, sizeof(UDJ1_MAGIC)) != 0) {
+        return Udj1ParseResult::kNotUdj1;
+    }
+    if (len != UDJ1_V1_SIZE && len != UDJ1_V2_SIZE) {
+        return Udj1ParseResult::kBadLength;
+    }
+    std::memcpy(out.angles, buf + UDJ1_ANGLES_OFFSET, sizeof(out.angles));
+
+    out.has_seq = (len == UDJ1_V2_SIZE);
+    out.seq = 0;
+    out.sender_ns = 0;
+    if (out.has_seq) {
+        std::memcpy(&out.seq, buf + UDJ1_SEQ_OFFSET, sizeof(out.seq));
+        std::memcpy(&out.sender_ns, buf + UDJ1_SENDER_TIME_OFFSET, sizeof(out.sender_ns));
+    }
+    return Udj1ParseResult::kOk;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+
+#include "latency_histogram.h"
+
+// UDJ1 version 2 の通し番号から，欠落・順序入れ替わり・重複を数える．
+// 直近 kWindow 個の番号は受信済みかどうかを覚えているので，遅れて届いたものと重複を区別できる．
+class Udj1SeqTracker final {
+public:
+    enum class Result {
+        kInOrder,     // 最新の番号より新しい (途中が抜けていれば欠落として数える)．
+        kReordered,   // 最新より古いが未受信だった．欠落から差し引く．
+        kDuplicate,   // 受信済み．
+        kRestart,     // 大きく巻き戻った．送信側が再起動したとみなして数え直す．
+    };
+
+    Result Observe(const uint32_t seq) {
+        ++received_;
+        if (!has_seq_) {
+            Restart(seq);
+            return Result::kInOrder;
+        }
+
+        const auto diff = static_cast<int32_t>(seq - highest_);
+        if (diff > 0) {
+            lost_ += static_cast<uint64_t>(diff - 1);
+            seen_ = (diff >= kWindow) ? 0 : (seen_ << diff);
+            seen_ |= 1;
+            highest_ = seq;
+            return Result::kInOrder;
+        }
+
+        const uint32_t behind = static_cast<uint32_t>(-static_cast<int64_t>(diff));
+        if (behind > kRestartDistance) {
+            ++restarts_;
+            Restart(seq);
+            return Result::kRestart;
+        }
+        if (behind < kWindow && (seen_ & (uint64_t{1} << behind)) != 0) {
+            ++duplicates_;
+            return Result::kDuplicate;
+        }
+        if (behind < kWindow) {
+            seen_ |= uint64_t{1} << behind;
+        }
+        ++reordered_;
+        if (lost_ > 0) {
+            --lost_;
+        }
+        return Result::kReordered;
+    }
+
+    uint64_t Received() const { return received_; }
+    uint64_t Lost() const { return lost_; }
+    uint64_t Reordered() const { return reordered_; }
+    uint64_t Duplicates() const { return duplicates_; }
+    uint64_t Restarts() const { return restarts_; }
+
+private:
+    static constexpr int32_t kWindow = 64;
+    static constexpr uint32_t kRestartDistance = 1024;
+
+    void Restart(const uint32_t seq) {
+        has_seq_ = true;
+        highest_ = seq;
+        seen_ = 1;
+    }
+
+    bool has_seq_ = false;
+    uint32_t highest_ = 0;
+    uint64_t seen_ = 0;  // bit i: highest_ - i を受信済み.
+
+    uint64_t received_ = 0;
+    uint64_t lost_ = 0;
+    uint64_t reordered_ = 0;
+    uint64_t duplicates_ = 0;
+    uint64_t restarts_ = 0;
+};
+
+// RUN に入ってから出るまで (1 セッション) の UDJ1 受信統計．
+// 書き込み・表示とも UDJ1 の受信スレッドから行う．
+class Udj1SessionStats final {
+public:
+    void Reset() { *this = Udj1SessionStats{}; }
+
+    bool Empty() const { return packets_ == 0; }
+
+    // パケットを 1 つ受信した．sender_ns / rx_time は version 2 のときだけ意味を持つ．
+    Udj1SeqTracker::Result Observe(const bool has_seq, const uint32_t seq,
+                                   const uint64_t sender_ns, const double rx_time) {
+        ++packets_;
+        if (!has_seq) {
+            return Udj1SeqTracker::Result::kInOrder;
+        }
+
+        const auto result = seq_.Observe(seq);
+        if (result == Udj1SeqTracker::Result::kRestart) {
+            has_offset_ = false;
+        }
+
+        // 送信側とは時計が違うので，(受信時刻 - 送信時刻) の最小値を基準にした遅れを測る.
+        // 最小値が更新されると過去の値は基準がずれるが，傾向を見るには十分.
+        const double offset = rx_time - static_cast<double>(sender_ns) * 1e-9;
+        if (!has_offset_ || offset < min_offset_) {
+            min_offset_ = offset;
+            has_offset_ = true;
+        }
+        network_delay_ns_.Record(static_cast<uint64_t>((offset - min_offset_) * 1e9));
+        return result;
+    }
+
+    // 受信してから CAN への書き込み (またはスケジューラへの受け渡し) が終わるまで．
+    void RecordTxLatency(const double seconds) {
+        tx_latency_ns_.Record(static_cast<uint64_t>(std::max(seconds, 0.0) * 1e9));
+    }
+
+    void Print(std::ostream& os) const {
+        os << "[UDJ1] session packets=" << packets_;
+        if (seq_.Received() > 0) {
+            const double loss = 100.0 * static_cast<double>(seq_.Lost())
+                              / static_cast<double>(seq_.Received() + seq_.Lost());
+            os << " seq: lost=" << seq_.Lost() << " (" << loss << "%)"
+               << " reordered=" << seq_.Reordered()
+               << " duplicate=" << seq_.Duplicates()
+               << " restart=" << seq_.Restarts();
+        }
+        os << std::endl;
+        if (network_delay_ns_.Count() > 0) {
+            network_delay_ns_.Print(os, "[UDJ1] network delay (above min):", "us", 1e-3);
+        }
+        if (tx_latency_ns_.Count() > 0) {
+            tx_latency_ns_.Print(os, "[UDJ1] rx -> CAN write:", "us", 1e-3);
+        }
+    }
+
+private:
+    uint64_t packets_ = 0;
+    Udj1SeqTracker seq_;
+
+    bool has_offset_ = false;
+    double min_offset_ = 0.0;
+    LatencyHistogram network_delay_ns_;
+    LatencyHistogram tx_latency_ns_;
+};
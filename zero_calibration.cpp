@@ -0,0 +1,334 @@
+#include "zero_calibration.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "calibration_store.h"
+#include "can_utils.h"
+#include "global_variable.h"
+#include "pot_handler.h"
+#include "robot_topology.h"
+#include "time_utils.h"
+
+namespace {
+// 関節ごとのゼロ点・回転方向・許容誤差と，どの脚に属するかは robot_topology.h の表で決める．
+// 胴体の関節 (leg が ROBOT_NO_LEG) はキャリブレーション不要．
+constexpr int kJointCount = static_cast<int>(ROBOT_JOINT_COUNT);
+
+// ☆ 1 ステップの移動量 [rot] = gain × |誤差 (ADC 値)| を [MIN, MAX] に丸めたもの．
+//    誤差の符号が反転した (行き過ぎた) 関節は gain を半分にする．
+constexpr float ZERO_CALIB_GAIN = 0.001f;
+constexpr float ZERO_CALIB_MIN_STEP = 0.01f;
+constexpr float ZERO_CALIB_MAX_STEP = 0.2f;
+constexpr int ZERO_CALIB_SETTLE_STEPS = 3;               // 許容範囲にこれだけ続けて収まったら完了.
+constexpr double ZERO_CALIB_STALE_TIMEOUT_SEC = 3.0;     // Pico の値が古いままこれだけ経ったら中止する.
+constexpr double ZERO_CALIB_TIMEOUT_SEC = 120.0;         // 全体がこれだけ経っても終わらなければ中止する.
+constexpr double ZERO_CALIB_LOG_INTERVAL_SEC = 1.0;      // 途中経過を表示する間隔.
+constexpr double ZERO_CALIB_ENCODER_MAX_AGE_SEC = 0.5;   // 保存するエンコーダ推定値の鮮度の上限.
+
+// ☆ ゼロ点合わせで使うポテンショメータ値．生の値で合わせたい場合は PotSource::kRaw にする.
+constexpr PotSource ZERO_CALIB_POT_SOURCE = PotSource::kFiltered;
+
+// ゼロ点合わせする関節の番号 (脚の順)．
+constexpr size_t kCalibJointCount = [] {
+    size_t count = 0;
+    for (const JointSpec& j : ROBOT_JOINTS) {
+        count += (j.leg != ROBOT_NO_LEG) ? 1 : 0;
+    }
+    return count;
+}();
+
+constexpr std::array<int, kCalibJointCount> kCalibJoints = [] {
+    std::array<int, kCalibJointCount> joints{};
+    size_t k = 0;
+    for (int leg = 0; leg < ROBOT_LEG_COUNT; ++leg) {
+        for (size_t i = 0; i < ROBOT_JOINT_COUNT; ++i) {
+            if (ROBOT_JOINTS[i].leg == leg) {
+                joints[k++] = static_cast<int>(i);
+            }
+        }
+    }
+    return joints;
+}();
+
+// 関節 i のポテンショメータ値．
+int pot_of(const PotValues& values, const int i) {
+    const JointSpec& spec = ROBOT_JOINTS[i];
+    return values[spec.pot_pico][spec.pot_channel];
+}
+
+struct JointState {
+    bool done = false;
+    double done_time = 0.0;
+    double send_pos = 0.0;  // 最後に送った位置 [rot].
+    float gain = ZERO_CALIB_GAIN;
+    int last_sign = 0;
+    int settled_steps = 0;
+    int last_error = 0;
+};
+
+struct Calibration {
+    std::vector<std::vector<int>> groups;  // 同時に動かす脚の組.
+    size_t current_group = 0;
+    std::array<JointState, kJointCount> joints{};
+    double start_time = 0.0;
+    double group_start_time = 0.0;
+    double last_log_time = 0.0;
+    double stale_since = -1.0;  // 必要な Pico の値が古くなった時刻．新しければ負.
+};
+
+Calibration calib;
+
+// 脚は反時計周りに並んでいるので，1 本おきに選ぶと対角の脚の組になる.
+std::vector<std::vector<int>> make_groups(const ZeroCalibPolicy policy) {
+    std::vector<std::vector<int>> groups;
+    switch (policy) {
+    case ZeroCalibPolicy::kAll:
+        groups.emplace_back();
+        for (int leg = 0; leg < ROBOT_LEG_COUNT; ++leg) {
+            groups[0].push_back(leg);
+        }
+        break;
+    case ZeroCalibPolicy::kDiagonalPairs:
+        groups.resize(2);
+        for (int leg = 0; leg < ROBOT_LEG_COUNT; ++leg) {
+            groups[leg % 2].push_back(leg);
+        }
+        break;
+    case ZeroCalibPolicy::kPerLeg:
+    default:
+        for (int leg = 0; leg < ROBOT_LEG_COUNT; ++leg) {
+            groups.push_back({leg});
+        }
+        break;
+    }
+    return groups;
+}
+
+// 現在の組で動かす関節 (完了済みを含む)．
+std::vector<int> group_joints() {
+    std::vector<int> joints;
+    for (const int leg : calib.groups[calib.current_group]) {
+        for (const int i : kCalibJoints) {
+            if (ROBOT_JOINTS[i].leg == leg) {
+                joints.push_back(i);
+            }
+        }
+    }
+    return joints;
+}
+
+void print_group(const char* what, const double now) {
+    std::cout << "[CTRL] Calib group " << calib.current_group << " (leg";
+    for (const int leg : calib.groups[calib.current_group]) {
+        std::cout << " " << (leg + 1);
+    }
+    std::cout << ") " << what;
+    if (std::strcmp(what, "done") == 0) {
+        std::cout << " in " << std::fixed << std::setprecision(2) << (now - calib.group_start_time) << " s"
+                  << std::defaultfloat;
+    }
+    std::cout << std::endl;
+}
+
+void print_progress(const std::vector<int>& joints) {
+    std::cout << "[CTRL] Calib remaining:";
+    for (const int i : joints) {
+        if (!calib.joints[i].done) {
+            std::cout << " j" << i << "=" << calib.joints[i].last_error;
+        }
+    }
+    std::cout << std::endl;
+}
+
+void print_summary(const double now) {
+    std::cout << "[CTRL] Zero calibration took " << std::fixed << std::setprecision(2)
+              << (now - calib.start_time) << " s. Per joint [s]:";
+    for (const int i : kCalibJoints) {
+        std::cout << " j" << i << "=" << (calib.joints[i].done_time - calib.start_time);
+    }
+    std::cout << std::defaultfloat << std::endl;
+}
+}  // namespace
+
+bool parse_zero_calib_policy(const char* text, ZeroCalibPolicy& out) {
+    if (std::strcmp(text, "leg") == 0) {
+        out = ZeroCalibPolicy::kPerLeg;
+    } else if (std::strcmp(text, "diagonal") == 0) {
+        out = ZeroCalibPolicy::kDiagonalPairs;
+    } else if (std::strcmp(text, "all") == 0) {
+        out = ZeroCalibPolicy::kAll;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void zero_calib_begin(const ZeroCalibPolicy policy, const double now) {
+    std::cout << "[CTRL] Potentiometer zero calibration command received. / ポテンショメータゼロ点キャリブレーションを行います．" << std::endl;
+
+    calib = Calibration{};
+    calib.groups = make_groups(policy);
+    calib.start_time = now;
+    calib.group_start_time = now;
+    calib.last_log_time = now;
+
+    // 初期化：キャリブレーション不要な関節は最初から完了にする.
+    for (int i = 0; i < kJointCount; ++i) {
+        calib.joints[i].done = (ROBOT_JOINTS[i].leg == ROBOT_NO_LEG);
+    }
+    print_group("start", now);
+}
+
+ZeroCalibStep zero_calib_step(const double now) {
+    if (calib.current_group >= calib.groups.size()) {
+        print_summary(now);
+        return ZeroCalibStep::kDone;
+    }
+    if (now - calib.start_time > ZERO_CALIB_TIMEOUT_SEC) {
+        std::cerr << "[CTRL] Zero calibration timed out." << std::endl;
+        print_progress(group_joints());
+        return ZeroCalibStep::kFailed;
+    }
+
+    const std::vector<int> joints = group_joints();
+
+    // 古いポテンショメータ値で ODrive を動かさないよう，対象の Pico が
+    // POT_MAX_AGE_SEC 以内に更新されていなければそのステップは何もしない．
+    int stale_pico = -1;
+    for (const int i : joints) {
+        if (!calib.joints[i].done && !pot_is_fresh(ROBOT_JOINTS[i].pot_pico)) {
+            stale_pico = ROBOT_JOINTS[i].pot_pico;
+            break;
+        }
+    }
+    if (stale_pico >= 0) {
+        if (calib.stale_since < 0.0) {
+            std::cout << "[CTRL] Pico " << stale_pico << " is stale (" << pot_age_sec(stale_pico) * 1000.0
+                      << " ms), waiting. / ポテンショメータ値が古いので待ちます．" << std::endl;
+            calib.stale_since = now;
+        }
+        if (now - calib.stale_since >= ZERO_CALIB_STALE_TIMEOUT_SEC) {
+            std::cerr << "[CTRL] Potentiometer values are stale. / ポテンショメータ値が更新されません．" << std::endl;
+            pot_report();
+            return ZeroCalibStep::kFailed;
+        }
+        return ZeroCalibStep::kContinue;
+    }
+    calib.stale_since = -1.0;
+
+    const PotValues pot_values = pot_latest_values(ZERO_CALIB_POT_SOURCE);
+
+    bool group_done = true;
+    for (const int i : joints) {
+        // 基本的にプログラム上ではモータの index は 0 始まりなので注意．
+        // CAN に送る段階で +1 する．
+        JointState& j = calib.joints[i];
+        if (j.done) {
+            continue;
+        }
+
+        const JointSpec& spec = ROBOT_JOINTS[i];
+        const int pot = pot_of(pot_values, i);
+        const int error = spec.pot_zero - pot;
+        j.last_error = error;
+
+        if (std::abs(error) <= spec.tolerance) {
+            // 許容範囲に続けて収まったら完了．その間は動かさない.
+            if (++j.settled_steps >= ZERO_CALIB_SETTLE_STEPS) {
+                j.done = true;
+                j.done_time = now;
+                std::cout << "[CTRL] Joint " << i << " done: pot=" << pot
+                          << " target=" << spec.pot_zero << std::endl;
+                continue;
+            }
+            group_done = false;
+            continue;
+        }
+        j.settled_steps = 0;
+        group_done = false;
+
+        // 行き過ぎたら移動量を小さくする.
+        const int sign = (error > 0) ? 1 : -1;
+        if (j.last_sign != 0 && sign != j.last_sign) {
+            j.gain *= 0.5f;
+        }
+        j.last_sign = sign;
+
+        // ポテンショメータ値を目標値に合わせるように ODrive に送信する.
+        const float step = std::clamp(j.gain * static_cast<float>(std::abs(error)),
+                                      ZERO_CALIB_MIN_STEP, ZERO_CALIB_MAX_STEP);
+        j.send_pos += sign * step * spec.direction;
+        send_position(robot_node_id(i), static_cast<float>(j.send_pos));
+    }
+
+    if (group_done) {
+        print_group("done", now);
+        ++calib.current_group;
+        calib.group_start_time = now;
+        if (calib.current_group >= calib.groups.size()) {
+            print_summary(now);
+            return ZeroCalibStep::kDone;
+        }
+        print_group("start", now);
+    } else if (now - calib.last_log_time >= ZERO_CALIB_LOG_INTERVAL_SEC) {
+        print_progress(joints);
+        calib.last_log_time = now;
+    }
+    return ZeroCalibStep::kContinue;
+}
+
+void zero_calib_capture(CalibrationRecord& out) {
+    const PotValues pot_values = pot_latest_values(ZERO_CALIB_POT_SOURCE);
+    const double now = now_time_sec();
+
+    out = CalibrationRecord{};
+    for (const int i : kCalibJoints) {
+        JointCalibration& joint = out.joints[i];
+        joint.flags = CALIB_FLAG_POT;
+        joint.pot_zero = static_cast<float>(pot_of(pot_values, i));
+
+        const auto estimate = g_encoder_estimates[i].Latest();
+        if (estimate && now - estimate->time <= ZERO_CALIB_ENCODER_MAX_AGE_SEC) {
+            joint.flags |= CALIB_FLAG_ENCODER;
+            joint.encoder_offset = estimate->value.pos;
+        }
+    }
+}
+
+bool zero_calib_pots_fresh() {
+    for (int pico = 0; pico < NUM_PICO; ++pico) {
+        if ((ROBOT_ZERO_CALIB_PICO_MASK >> pico) & 1 && !pot_is_fresh(pico)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool zero_calib_matches(const CalibrationRecord& record) {
+    const PotValues pot_values = pot_latest_values(ZERO_CALIB_POT_SOURCE);
+
+    bool ok = true;
+    for (const int i : kCalibJoints) {
+        const JointCalibration& joint = record.joints[i];
+        if ((joint.flags & CALIB_FLAG_POT) == 0) {
+            std::cout << "[CTRL] Joint " << i << " has no saved zero." << std::endl;
+            ok = false;
+            continue;
+        }
+        const float tolerance = ROBOT_JOINTS[i].tolerance;
+        const int pot = pot_of(pot_values, i);
+        const float error = static_cast<float>(pot) - joint.pot_zero;
+        if (std::abs(error) > tolerance) {
+            std::cout << "[CTRL] Joint " << i << " moved: pot=" << pot << " saved=" << joint.pot_zero
+                      << " (tolerance " << tolerance << ")" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// ポテンショメータを使った関節のゼロ点合わせ．
+// 各関節を，ポテンショメータ値がゼロ点 (robot_topology.h の pot_zero) に一致するまで少しずつ動かす．
+// 1 回の移動量は残りの誤差に比例させ，誤差が許容範囲に数ステップ続けて収まったら完了とする．
+// zero_calib_step() を一定周期で呼んで進める (呼び出し側を止めない)．
+
+struct CalibrationRecord;
+
+// 同時に動かす脚の組み合わせ．胴体の関節 (robot_topology.h で脚に属さないもの) はゼロ点合わせしない．
+enum class ZeroCalibPolicy {
+    kPerLeg,         // 1 脚ずつ (leg1 → leg2 → leg3 → leg4)．
+    kDiagonalPairs,  // 1 本おきの脚ずつ (4 脚なら対角の leg1 + leg3 → leg2 + leg4)．残りの脚で体を支えられる.
+    kAll,            // 全脚を同時に．
+};
+
+enum class ZeroCalibStep {
+    kContinue,
+    kDone,
+    kFailed,  // Pico の値が古いまま，または全体が時間内に終わらなかった.
+};
+
+// 文字列 ("leg" / "diagonal" / "all") から policy を得る．解釈できなければ false．
+bool parse_zero_calib_policy(const char* text, ZeroCalibPolicy& out);
+
+void zero_calib_begin(ZeroCalibPolicy policy, double now);
+ZeroCalibStep zero_calib_step(double now);
+
+// ===== 保存したキャリブレーション結果 (calibration_store.h) =====
+
+// 現在のポテンショメータ値と ODrive の位置推定値をゼロ点として out に書く．
+// zero_calib_step() が kDone を返した直後，絶対位置を 0 にする前に呼ぶこと．
+void zero_calib_capture(CalibrationRecord& out);
+
+// ゼロ点合わせする関節のポテンショメータ値がすべて新しければ true．
+bool zero_calib_pots_fresh();
+
+// 現在のポテンショメータ値が，record のゼロ点から関節ごとの許容誤差以内なら true．
+// 外れた関節があれば表示する．
+bool zero_calib_matches(const CalibrationRecord& record);